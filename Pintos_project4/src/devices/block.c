@@ -4,6 +4,10 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Most sectors the service thread merges into one driver call. */
+#define BLOCK_MERGE_MAX 128
 
 /* A block device. */
 struct block
@@ -19,6 +23,18 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    struct block *parent;               /* Device a partition lives on. */
+    block_sector_t start;               /* First sector within PARENT. */
+
+    /* Request queue, used only on devices without a parent. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_cond;        /* Signaled on a new request. */
+    struct list queue;                  /* Pending requests, by sector. */
+    block_sector_t head;                /* Sector after the last served. */
+    bool server;                        /* Service thread started? */
+    size_t depth;                       /* Requests queued or in service. */
+    struct block_stats stats;           /* Request statistics. */
   };
 
 /* List of all block devices. */
@@ -28,6 +44,16 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void block_service (void *block_);
+
+/* Returns the CPU's time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -81,6 +107,16 @@ block_next (struct block *block)
   return list_elem_to_block (list_next (&block->list_elem));
 }
 
+/* Returns the whole device that BLOCK is a partition of, or BLOCK
+   itself if it is not a partition. */
+struct block *
+block_root (struct block *block)
+{
+  while (block->parent != NULL)
+    block = block->parent;
+  return block;
+}
+
 /* Returns the block device with the given NAME, or a null
    pointer if no block device has that name. */
 struct block *
@@ -113,6 +149,22 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Submits a request for CNT sectors of BLOCK starting at SECTOR
+   and waits for it. */
+static void
+block_io (struct block *block, block_sector_t sector, size_t cnt,
+          void *buffers[], bool write)
+{
+  struct block_request req;
+
+  req.sector = sector;
+  req.cnt = cnt;
+  req.buffers = buffers;
+  req.write = write;
+  block_submit (block, &req);
+  block_wait (&req);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +172,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_io (block, sector, 1, &buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +183,239 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer); //#A unique for every device
-  block->write_cnt++;
+  void *buf = (void *) buffer;
+  block_io (block, sector, 1, &buf, true);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK,
+   sector I into BUFFERS[I], with as few device commands as the
+   driver allows. */
+void
+block_read_multi (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffers[])
+{
+  if (cnt > 0)
+    block_io (block, sector, cnt, buffers, false);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK,
+   sector I from BUFFERS[I].  Returns after the device has
+   acknowledged all of them. */
+void
+block_write_multi (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *buffers[])
+{
+  if (cnt > 0)
+    block_io (block, sector, cnt, (void **) buffers, true);
+}
+
+/* Orders requests by first sector.  Equal sectors keep their
+   arrival order. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return a->sector < b->sector;
+}
+
+/* Queues REQ on BLOCK and returns without waiting for it; call
+   block_wait() to do that.  Requests on a partition go to the
+   queue of the device it lives on, and REQ->sector is rewritten
+   to match.  Requests for overlapping sectors that are in flight
+   at the same time complete in no particular order, so callers
+   (e.g. the buffer cache) must serialize those themselves. */
+void
+block_submit (struct block *block, struct block_request *req)
+{
+  ASSERT (req->cnt > 0);
+
+  sema_init (&req->done, 0);
+  for (;;)
+    {
+      check_sector (block, req->sector);
+      check_sector (block, req->sector + req->cnt - 1);
+      if (req->write)
+        {
+          ASSERT (block->type != BLOCK_FOREIGN);
+          block->write_cnt += req->cnt;
+        }
+      else
+        block->read_cnt += req->cnt;
+      if (block->parent == NULL)
+        break;
+      req->sector += block->start;
+      block = block->parent;
+    }
+
+  lock_acquire (&block->queue_lock);
+  if (!block->server)
+    {
+      block->server = true;
+      thread_create (block->name, PRI_DEFAULT, block_service, block);
+    }
+  block->stats.req_cnt++;
+  block->stats.depth[block->depth < BLOCK_DEPTH_CNT
+                     ? block->depth : BLOCK_DEPTH_CNT - 1]++;
+  block->depth++;
+  req->submit_tsc = rdtsc ();
+  list_insert_ordered (&block->queue, &req->elem, request_less, NULL);
+  cond_signal (&block->queue_cond, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for REQ, which was passed to block_submit(), to
+   complete. */
+void
+block_wait (struct block_request *req)
+{
+  sema_down (&req->done);
+}
+
+/* Removes and returns the next request of BLOCK's queue in C-SCAN
+   order: the lowest sector at or after the head, or the lowest
+   sector overall once the sweep reaches the end.  Requests right
+   after it in the same direction are moved to BATCH with it, up
+   to BLOCK_MERGE_MAX sectors in all.  Returns the sector count of
+   the batch.  BLOCK's queue_lock must be held. */
+static size_t
+next_batch (struct block *block, struct list *batch)
+{
+  struct list_elem *e;
+  struct block_request *first;
+  size_t cnt;
+
+  ASSERT (!list_empty (&block->queue));
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector >= block->head)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+
+  first = list_entry (e, struct block_request, elem);
+  cnt = first->cnt;
+  e = list_remove (e);
+  list_push_back (batch, &first->elem);
+  while (e != list_end (&block->queue))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->sector != first->sector + cnt || r->write != first->write
+          || cnt + r->cnt > BLOCK_MERGE_MAX)
+        break;
+      cnt += r->cnt;
+      e = list_remove (e);
+      list_push_back (batch, &r->elem);
+    }
+  block->head = first->sector + cnt;
+  return cnt;
+}
+
+/* Counts REQ, which just completed, in BLOCK's statistics.
+   BLOCK's queue_lock must be held. */
+static void
+record_latency (struct block *block, const struct block_request *req)
+{
+  uint64_t cycles = rdtsc () - req->submit_tsc;
+  int bucket = 0;
+
+  while (cycles > 1 && bucket < BLOCK_LAT_CNT - 1)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  if (req->write)
+    {
+      block->stats.write_cnt += req->cnt;
+      block->stats.write_lat[bucket]++;
+    }
+  else
+    {
+      block->stats.read_cnt += req->cnt;
+      block->stats.read_lat[bucket]++;
+    }
+}
+
+/* Service thread for BLOCK's request queue.  Takes batches in
+   C-SCAN order and hands each to the driver as one transfer; the
+   driver sleeps until its completion interrupt, and then the
+   waiters are woken and the next batch goes out. */
+static void
+block_service (void *block_)
+{
+  struct block *block = block_;
+  const struct block_operations *ops = block->ops;
+
+  for (;;)
+    {
+      void *merged[BLOCK_MERGE_MAX];
+      struct list batch;
+      struct block_request *first;
+      block_sector_t sector;
+      void **buffers;
+      size_t cnt, i;
+
+      list_init (&batch);
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_cond, &block->queue_lock);
+      cnt = next_batch (block, &batch);
+      lock_release (&block->queue_lock);
+
+      first = list_entry (list_front (&batch), struct block_request, elem);
+      sector = first->sector;
+      buffers = first->buffers;
+      if (first->cnt != cnt)
+        {
+          struct list_elem *e;
+          size_t n = 0;
+          for (e = list_begin (&batch); e != list_end (&batch);
+               e = list_next (e))
+            {
+              struct block_request *r
+                = list_entry (e, struct block_request, elem);
+              for (i = 0; i < r->cnt; i++)
+                merged[n++] = r->buffers[i];
+            }
+          buffers = merged;
+        }
+
+      if (first->write)
+        {
+          if (cnt == 1)
+            ops->write (block->aux, sector, buffers[0]);
+          else if (ops->write_multi != NULL)
+            ops->write_multi (block->aux, sector, cnt,
+                              (const void **) buffers);
+          else
+            for (i = 0; i < cnt; i++)
+              ops->write (block->aux, sector + i, buffers[i]);
+        }
+      else
+        {
+          if (cnt == 1)
+            ops->read (block->aux, sector, buffers[0]);
+          else if (ops->read_multi != NULL)
+            ops->read_multi (block->aux, sector, cnt, buffers);
+          else
+            for (i = 0; i < cnt; i++)
+              ops->read (block->aux, sector + i, buffers[i]);
+        }
+
+      /* A waiter may free its request as soon as it wakes. */
+      lock_acquire (&block->queue_lock);
+      block->stats.batch_cnt++;
+      while (!list_empty (&batch))
+        {
+          struct block_request *r = list_entry (list_pop_front (&batch),
+                                                struct block_request, elem);
+          record_latency (block, r);
+          block->depth--;
+          sema_up (&r->done);
+        }
+      lock_release (&block->queue_lock);
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,15 +439,43 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Copies the request statistics of the device BLOCK is on into
+   *STATS. */
+void
+block_get_stats (struct block *block, struct block_stats *stats)
+{
+  block = block_root (block);
+  lock_acquire (&block->queue_lock);
+  *stats = block->stats;
+  lock_release (&block->queue_lock);
+}
+
+/* Prints the non-empty buckets of histogram HIST, which has CNT
+   buckets, after LABEL. */
+static void
+print_histogram (const char *label, const unsigned long long *hist,
+                 int cnt)
+{
+  int i;
+
+  printf ("  %s:", label);
+  for (i = 0; i < cnt; i++)
+    if (hist[i] != 0)
+      printf (" %d:%llu", i, hist[i]);
+  printf ("\n");
+}
+
+/* Prints statistics for each block device used for a Pintos role,
+   then latency and queue depth for each disk that saw requests. */
 void
 block_print_stats (void)
 {
+  struct block *block;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
     {
-      struct block *block = block_by_role[i];
+      block = block_by_role[i];
       if (block != NULL)
         {
           printf ("%s (%s): %llu reads, %llu writes\n",
@@ -176,13 +483,27 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+
+  for (block = block_first (); block != NULL; block = block_next (block))
+    if (block->parent == NULL && block->stats.req_cnt > 0)
+      {
+        printf ("%s: %llu requests in %llu transfers\n", block->name,
+                block->stats.req_cnt, block->stats.batch_cnt);
+        print_histogram ("read latency, log2 cycles",
+                         block->stats.read_lat, BLOCK_LAT_CNT);
+        print_histogram ("write latency, log2 cycles",
+                         block->stats.write_lat, BLOCK_LAT_CNT);
+        print_histogram ("queue depth on submit",
+                         block->stats.depth, BLOCK_DEPTH_CNT);
+      }
 }
 
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
    be provided, as well as the it operation functions OPS, which
-   will be passed AUX in each function call. */
+   will be passed AUX in each function call.  A partition, which
+   block_set_parent() then ties to its device, has no OPS. */
 struct block *
 block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
@@ -200,6 +521,15 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->parent = NULL;
+  block->start = 0;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_cond);
+  list_init (&block->queue);
+  block->head = 0;
+  block->server = false;
+  block->depth = 0;
+  memset (&block->stats, 0, sizeof block->stats);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -211,6 +541,17 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Makes BLOCK a partition that starts at sector START of PARENT,
+   so that its requests join PARENT's queue. */
+void
+block_set_parent (struct block *block, struct block *parent,
+                  block_sector_t start)
+{
+  ASSERT (start + block->size <= parent->size);
+  block->parent = parent;
+  block->start = start;
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -48,15 +51,62 @@ struct block *block_get_by_name (const char *name);
 
 struct block *block_first (void);
 struct block *block_next (struct block *);
+struct block *block_root (struct block *);
 
 /* Block device operations. */
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t, size_t cnt,
+                       void *buffers[]);
+void block_write_multi (struct block *, block_sector_t, size_t cnt,
+                        const void *buffers[]);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* An asynchronous request for CNT consecutive sectors starting at
+   SECTOR, sector I going to or from BUFFERS[I].  The caller fills
+   in those fields and WRITE, passes it to block_submit(), and
+   keeps it and the buffers alive until block_wait() returns. */
+struct block_request
+  {
+    block_sector_t sector;      /* First sector, rewritten on submit. */
+    size_t cnt;                 /* Number of sectors. */
+    void **buffers;             /* One buffer per sector. */
+    bool write;                 /* Write, or read? */
+
+    struct list_elem elem;      /* Element in the device queue. */
+    uint64_t submit_tsc;        /* TSC when submitted, for latency. */
+    struct semaphore done;      /* Up'd when the transfer completes. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
+
+/* Latency buckets: bucket I counts requests that took from 2**I
+   to 2**(I+1) TSC cycles, submit to completion; the last bucket
+   also counts anything slower. */
+#define BLOCK_LAT_CNT 32
+
+/* Queue depth buckets: bucket I counts requests that found I
+   others queued or in service; the last also counts deeper. */
+#define BLOCK_DEPTH_CNT 16
+
+/* Request statistics of a whole device (partitions share theirs). */
+struct block_stats
+  {
+    unsigned long long read_cnt;        /* Sectors read. */
+    unsigned long long write_cnt;       /* Sectors written. */
+    unsigned long long req_cnt;         /* Requests submitted. */
+    unsigned long long batch_cnt;       /* Driver transfers, merged. */
+    unsigned long long read_lat[BLOCK_LAT_CNT];
+    unsigned long long write_lat[BLOCK_LAT_CNT];
+    unsigned long long depth[BLOCK_DEPTH_CNT];
+  };
+
+void block_get_stats (struct block *, struct block_stats *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
@@ -65,10 +115,19 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional, may be null: CNT consecutive sectors starting at
+       the given one, sector I going to or from BUFFERS[I]. */
+    void (*read_multi) (void *aux, block_sector_t, size_t cnt,
+                        void *buffers[]);
+    void (*write_multi) (void *aux, block_sector_t, size_t cnt,
+                         const void *buffers[]);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_set_parent (struct block *, struct block *parent,
+                       block_sector_t start);
 
 #endif /* devices/block.h */
@@ -3,12 +3,15 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -34,6 +37,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +53,46 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+#define CMD_READ_DMA 0xc8               /* READ DMA with retries. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA with retries. */
+
+/* Most sectors one command can move (sector count 0 means 256). */
+#define IDE_MAX_SECTORS 256
+
+/* PCI configuration space, mechanism #1. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+#define PCI_REG_COMMAND 0x04    /* Command (low 16 bits). */
+#define PCI_REG_CLASS 0x08      /* Class, subclass, prog IF, revision. */
+#define PCI_REG_BAR4 0x20       /* Bus master IDE base for PIIX. */
+#define PCI_CMD_IO 0x0001       /* I/O space enable. */
+#define PCI_CMD_MASTER 0x0004   /* Bus master enable. */
+
+/* Bus master IDE registers, per channel (channel 1 is at +8). */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)
+
+/* Bus master command and status bits. */
+#define BM_CMD_START 0x01       /* Start/stop bus master. */
+#define BM_CMD_READ 0x08        /* Device to memory. */
+#define BM_STA_ERR 0x02         /* Transfer error, write 1 to clear. */
+#define BM_STA_IRQ 0x04         /* Interrupt, write 1 to clear. */
+
+/* A physical region descriptor.  A region may not cross a 64 kB
+   boundary; a byte count of 0 means 64 kB. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Byte count. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +101,10 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multi_cnt;              /* Sectors per interrupt for READ/WRITE
+                                   MULTIPLE, 0 if not supported. */
+    bool dma;                   /* Use READ/WRITE DMA? */
+    struct block *block;        /* Registered device, if any. */
   };
 
 /* An ATA channel (aka controller).
@@ -66,6 +114,8 @@ struct channel
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master registers, 0 for PIO only. */
+    struct prd *prdt;           /* PRD table, one page. */
 
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
@@ -86,6 +136,11 @@ static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
 static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
+static void set_multiple_mode (struct ata_disk *, int cnt);
+static uint16_t find_bus_master (void);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          void *buffers[], bool write);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -102,6 +157,7 @@ void
 ide_init (void) 
 {
   size_t chan_no;
+  uint16_t bm_base = find_bus_master ();
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
@@ -123,6 +179,14 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
@@ -136,6 +200,9 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multi_cnt = 0;
+          d->dma = false;
+          d->block = NULL;
         }
 
       /* Register interrupt handler. */
@@ -155,6 +222,24 @@ ide_init (void)
     }
 }
 
+/* Returns the number of the IDE channel that BLOCK, or the disk
+   it is a partition of, is attached to, or -1 if BLOCK is not on
+   an IDE disk.  Disks on different channels can transfer at the
+   same time; disks on one channel take turns. */
+int
+ide_channel (struct block *block)
+{
+  struct block *root = block_root (block);
+  size_t chan_no;
+  int dev_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    for (dev_no = 0; dev_no < 2; dev_no++)
+      if (channels[chan_no].devices[dev_no].block == root)
+        return chan_no;
+  return -1;
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -303,9 +388,21 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Turn on READ/WRITE MULTIPLE with the largest block size the
+     disk supports (IDENTIFY word 47, low byte). */
+  set_multiple_mode (d, (uint8_t) id[47 * 2]);
+
+  /* Use bus master DMA if the controller has it and the disk
+     supports DMA (IDENTIFY word 49, bit 8). */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+  if (d->dma)
+    snprintf (extra_info + strlen (extra_info),
+              sizeof extra_info - strlen (extra_info), ", DMA");
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  d->block = block;
   partition_scan (block);
 }
 
@@ -346,6 +443,8 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  if (d->dma && dma_transfer (d, sec_no, 1, &buffer, false))
+    return;
   lock_acquire (&c->lock);
   select_sector (d, sec_no);
   issue_pio_command (c, CMD_READ_SECTOR_RETRY);
@@ -366,6 +465,8 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  if (d->dma && dma_transfer (d, sec_no, 1, (void **) &buffer, true))
+    return;
   lock_acquire (&c->lock);
   select_sector (d, sec_no);
   issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
@@ -376,24 +477,267 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   lock_release (&c->lock);
 }
 
+/* Reads CNT sectors starting at SEC_NO from disk D, sector I
+   into BUFFERS[I].  Each command moves up to IDE_MAX_SECTORS, with
+   one interrupt per D->multi_cnt sectors if READ MULTIPLE is on,
+   or per sector otherwise. */
+static void
+ide_read_multi (void *d_, block_sector_t sec_no, size_t cnt, void *buffers[])
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  size_t per_irq = d->multi_cnt > 0 ? (size_t) d->multi_cnt : 1;
+  size_t done = 0;
+
+  if (d->dma && dma_transfer (d, sec_no, cnt, buffers, false))
+    return;
+  lock_acquire (&c->lock);
+  while (done < cnt)
+    {
+      size_t n = cnt - done < IDE_MAX_SECTORS ? cnt - done : IDE_MAX_SECTORS;
+      size_t i = 0;
+      select_sectors (d, sec_no + done, n);
+      issue_pio_command (c, d->multi_cnt > 0 ? CMD_READ_MULTIPLE
+                                             : CMD_READ_SECTOR_RETRY);
+      while (i < n)
+        {
+          size_t j;
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + done + i);
+          for (j = 0; j < per_irq && i < n; j++, i++)
+            input_sector (c, buffers[done + i]);
+        }
+      done += n;
+    }
+  lock_release (&c->lock);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D, sector I from
+   BUFFERS[I], the same way ide_read_multi() reads them.  Returns
+   after the disk has acknowledged the last one. */
+static void
+ide_write_multi (void *d_, block_sector_t sec_no, size_t cnt,
+                 const void *buffers[])
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  size_t per_irq = d->multi_cnt > 0 ? (size_t) d->multi_cnt : 1;
+  size_t done = 0;
+
+  if (d->dma && dma_transfer (d, sec_no, cnt, (void **) buffers, true))
+    return;
+  lock_acquire (&c->lock);
+  while (done < cnt)
+    {
+      size_t n = cnt - done < IDE_MAX_SECTORS ? cnt - done : IDE_MAX_SECTORS;
+      size_t i = 0;
+      select_sectors (d, sec_no + done, n);
+      issue_pio_command (c, d->multi_cnt > 0 ? CMD_WRITE_MULTIPLE
+                                             : CMD_WRITE_SECTOR_RETRY);
+      while (i < n)
+        {
+          size_t j;
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + done + i);
+          for (j = 0; j < per_irq && i < n; j++, i++)
+            output_sector (c, buffers[done + i]);
+          sema_down (&c->completion_wait);
+        }
+      done += n;
+    }
+  lock_release (&c->lock);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi
   };
+
+/* Bus master DMA. */
+
+/* Reads the 32-bit PCI configuration register REG of BUS:DEV.FN. */
+static uint32_t
+pci_read_config (int bus, int dev, int fn, int reg)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (fn << 8) | (reg & 0xfc));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to PCI configuration register REG of BUS:DEV.FN. */
+static void
+pci_write_config (int bus, int dev, int fn, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (fn << 8) | (reg & 0xfc));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can bus master
+   (PIIX and compatibles, as QEMU emulates), turns on bus
+   mastering, and returns the I/O base of its bus master
+   registers.  Returns 0 if there is none, so we stay with PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, fn;
+
+  for (dev = 0; dev < 32; dev++)
+    for (fn = 0; fn < 8; fn++)
+      {
+        uint32_t class = pci_read_config (0, dev, fn, PCI_REG_CLASS);
+        uint32_t bar, cmd;
+
+        if (pci_read_config (0, dev, fn, 0) == 0xffffffff)
+          {
+            if (fn == 0)
+              break;            /* No such device. */
+            continue;
+          }
+        /* Mass storage, IDE, bus master capable. */
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+        bar = pci_read_config (0, dev, fn, PCI_REG_BAR4);
+        if ((bar & 1) == 0 || (bar & 0xfffc) == 0)
+          continue;
+        cmd = pci_read_config (0, dev, fn, PCI_REG_COMMAND);
+        pci_write_config (0, dev, fn, PCI_REG_COMMAND,
+                          (cmd & 0xffff) | PCI_CMD_IO | PCI_CMD_MASTER);
+        return bar & 0xfffc;
+      }
+  return 0;
+}
+
+/* Appends the LEN bytes at kernel address BUF to C's PRD table,
+   which has *CNT entries, splitting at 64 kB boundaries and
+   merging with the previous entry when physically adjacent. */
+static void
+prd_add (struct channel *c, size_t *cnt, const void *buf, size_t len)
+{
+  uint32_t addr;
+
+  ASSERT (is_kernel_vaddr (buf));
+  addr = vtop (buf);
+  ASSERT ((addr & 1) == 0 && (len & 1) == 0);   /* Bit 0 is reserved. */
+  while (len > 0)
+    {
+      size_t room = 0x10000 - (addr & 0xffff);
+      size_t n = len < room ? len : room;
+      struct prd *last = *cnt > 0 ? &c->prdt[*cnt - 1] : NULL;
+
+      if (last != NULL && (last->addr >> 16) == (addr >> 16)
+          && last->addr + last->size == addr)
+        last->size += n;        /* May wrap to 0, meaning 64 kB. */
+      else
+        {
+          ASSERT (*cnt < PRD_CNT);
+          c->prdt[*cnt].addr = addr;
+          c->prdt[*cnt].size = n;
+          c->prdt[*cnt].flags = 0;
+          (*cnt)++;
+        }
+      addr += n;
+      len -= n;
+    }
+}
+
+/* Moves CNT sectors starting at SEC_NO between disk D and
+   BUFFERS[], which must be kernel addresses, with READ/WRITE DMA.
+   The controller copies the data, so the CPU runs other threads
+   until the completion interrupt.
+   Returns false without doing anything if a buffer is not word
+   aligned, as the bus master requires; the caller then uses PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              void *buffers[], bool write)
+{
+  struct channel *c = d->channel;
+  size_t done = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if ((uintptr_t) buffers[i] & 1)
+      return false;
+  lock_acquire (&c->lock);
+  while (done < cnt)
+    {
+      size_t n = cnt - done < IDE_MAX_SECTORS ? cnt - done : IDE_MAX_SECTORS;
+      size_t prd_cnt = 0;
+      uint8_t bm_status;
+
+      for (i = 0; i < n; i++)
+        prd_add (c, &prd_cnt, buffers[done + i], BLOCK_SECTOR_SIZE);
+      c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+      outb (reg_bm_command (c), 0);
+      outl (reg_bm_prdt (c), vtop (c->prdt));
+      outb (reg_bm_status (c), BM_STA_ERR | BM_STA_IRQ);
+      outb (reg_bm_command (c), write ? 0 : BM_CMD_READ);
+
+      select_sectors (d, sec_no + done, n);
+      issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+      outb (reg_bm_command (c), (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+      sema_down (&c->completion_wait);
+
+      outb (reg_bm_command (c), 0);
+      bm_status = inb (reg_bm_status (c));
+      outb (reg_bm_status (c), BM_STA_ERR | BM_STA_IRQ);
+      if ((bm_status & BM_STA_ERR) || (inb (reg_status (c)) & STA_ERR))
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+               d->name, write ? "write" : "read", sec_no + done);
+      done += n;
+    }
+  lock_release (&c->lock);
+  return true;
+}
+
+/* Sends SET MULTIPLE MODE to disk D for CNT sectors per interrupt,
+   and records the result in D->multi_cnt.  CNT of 0 leaves READ/WRITE
+   MULTIPLE off. */
+static void
+set_multiple_mode (struct ata_disk *d, int cnt)
+{
+  struct channel *c = d->channel;
+
+  d->multi_cnt = 0;
+  if (cnt <= 0)
+    return;
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multi_cnt = cnt;
+}
 
 /* Selects device D, waiting for it to become ready, and then
    writes SEC_NO to the disk's sector selection registers.  (We
    use LBA mode.) */
 static void
 select_sector (struct ata_disk *d, block_sector_t sec_no)
+{
+  select_sectors (d, sec_no, 1);
+}
+
+/* As select_sector(), for a run of CNT sectors starting at SEC_NO.
+   CNT must be between 1 and IDE_MAX_SECTORS. */
+static void
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= IDE_MAX_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt); /* 256 wraps to 0, which means 256. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -1,6 +1,9 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+struct block;
+
 void ide_init (void);
+int ide_channel (struct block *);
 
 #endif /* devices/ide.h */
@@ -12,6 +12,12 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
+//@4-1 #include
+#include "filesys/cache.h"
+//@4-4 #include
+#include "filesys/dcache.h"
+//@4-2 #include
+#include "filesys/journal.h"
 #endif
 
 /* Keyboard control register port. */
@@ -132,6 +138,9 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  cache_print_stats ();
+  dcache_print_stats ();
+  journal_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
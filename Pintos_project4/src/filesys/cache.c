@@ -1,88 +1,692 @@
 //@4-1 #include
 #include "filesys/cache.h"
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/timer.h"
 #include "threads/synch.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
+//@4-2 #include
+#include "filesys/journal.h"
+//@4-1 Global-Val, index
+static struct hash cache_index;     //#A sector -> cache_entry, valid only
+static struct list cache_free_list; //#A cache_entry, invalid only
+//@4-1 Global-Val, replacement
+enum cache_policy cache_policy = CACHE_CLOCK;
+static int clock_hand;              //#A clock: next entry to look at
+static struct list a1in_list;       //#A 2Q: FIFO, first touch
+static struct list am_list;         //#A 2Q: LRU, touched again
+static size_t a1in_cnt;
+static block_sector_t a1out[CACHE_A1OUT_SIZE]; //#A 2Q: ghost ring
+static int a1out_head, a1out_cnt;
+//@4-3 Global-Val
+static struct condition cache_unpinned; //#A signaled when open_cnt hits 0
+//@4-1 Global-Val, write-behind
+static struct list cache_dirty_list; //#A dirty entries, unordered
+static size_t dirty_cnt;
+static struct semaphore flush_wake;  //#A up'd by timer or by threshold
+//@4-1 Global-Val, read-ahead
+static block_sector_t ra_queue[CACHE_RA_QUEUE_SIZE]; //#A ring
+static int ra_head, ra_cnt;
+static struct lock ra_lock;
+static struct condition ra_ready;
+//@4-1 Global-Val, stats
+static unsigned long long cache_hit_cnt, cache_miss_cnt;
+static unsigned long long ra_used_cnt, ra_wasted_cnt;
+static unsigned long long direct_cnt; //#A sectors that bypassed the cache
+static unsigned long long evict_cnt, evict_write_cnt, flush_write_cnt;
+
+//@4-1 F: cache_hash
+static unsigned cache_hash(const struct hash_elem *e, void *aux UNUSED){
+    return hash_int(hash_entry(e, struct cache_entry, hash_elem)->sector);
+}
+//@4-1 F: cache_less
+static bool cache_less(const struct hash_elem *a, const struct hash_elem *b,
+                       void *aux UNUSED){
+    return hash_entry(a, struct cache_entry, hash_elem)->sector
+           < hash_entry(b, struct cache_entry, hash_elem)->sector;
+}
+//@4-1 F: cache_find, hold arr_lock_cache
+static struct cache_entry *cache_find(block_sector_t sector){
+    struct cache_entry key;
+    key.sector = sector;
+    struct hash_elem *e = hash_find(&cache_index, &key.hash_elem);
+    return e != NULL ? hash_entry(e, struct cache_entry, hash_elem) : NULL;
+}
+
+//@4-1 F: a1out_take, true if SECTOR was a ghost (and forget it)
+static bool a1out_take(block_sector_t sector){
+    for (int i = 0; i < a1out_cnt; i++){
+        int idx = (a1out_head + i) % CACHE_A1OUT_SIZE;
+        if (a1out[idx] != sector)
+            continue;
+        //#A fill the hole with the oldest ghost
+        a1out[idx] = a1out[a1out_head];
+        a1out_head = (a1out_head + 1) % CACHE_A1OUT_SIZE;
+        a1out_cnt--;
+        return true;
+    }
+    return false;
+}
+//@4-1 F: a1out_push, oldest ghost drops out when full
+static void a1out_push(block_sector_t sector){
+    if (a1out_cnt == CACHE_A1OUT_SIZE){
+        a1out_head = (a1out_head + 1) % CACHE_A1OUT_SIZE;
+        a1out_cnt--;
+    }
+    a1out[(a1out_head + a1out_cnt) % CACHE_A1OUT_SIZE] = sector;
+    a1out_cnt++;
+}
+//@4-1 F: queue_remove, take CE off its 2Q list
+static void queue_remove(struct cache_entry *ce){
+    if (ce->queue == CACHE_Q_NONE)
+        return;
+    list_remove(&ce->q_elem);
+    if (ce->queue == CACHE_Q_A1IN)
+        a1in_cnt--;
+    ce->queue = CACHE_Q_NONE;
+}
+//@4-1 F: cache_touch, on hit
+static void cache_touch(struct cache_entry *ce){
+    ce->accessed = true;
+    if (cache_policy == CACHE_2Q && ce->queue == CACHE_Q_AM){
+        list_remove(&ce->q_elem);
+        list_push_back(&am_list, &ce->q_elem); //#A MRU
+    }
+}
+//@4-1 F: cache_place, on miss, CE just got SECTOR
+static void cache_place(struct cache_entry *ce){
+    ce->accessed = true;
+    if (cache_policy != CACHE_2Q)
+        return;
+    if (a1out_take(ce->sector)){ //#A seen recently: really hot
+        ce->queue = CACHE_Q_AM;
+        list_push_back(&am_list, &ce->q_elem);
+    }
+    else{
+        ce->queue = CACHE_Q_A1IN;
+        list_push_back(&a1in_list, &ce->q_elem);
+        a1in_cnt++;
+    }
+}
+//@4-1 F: first_unpinned, from front of a 2Q list
+static struct cache_entry *first_unpinned(struct list *l){
+    struct list_elem *e;
+    for (e = list_begin(l); e != list_end(l); e = list_next(e)){
+        struct cache_entry *ce = list_entry(e, struct cache_entry, q_elem);
+        if (ce->open_cnt == 0 && ce->held_txn == 0) //@4-2 C: held, as pinned
+            return ce;
+    }
+    return NULL;
+}
+//@4-1 F: pick_victim_clock, second-chance
+static struct cache_entry *pick_victim_clock(void){
+    for (int n = 0; n < 2 * CACHE_MAX_SIZE; n++){
+        struct cache_entry *ce = &cache[clock_hand];
+        clock_hand = (clock_hand + 1) % CACHE_MAX_SIZE;
+        if (ce->open_cnt > 0 || ce->held_txn != 0) //@4-2 C: held, as pinned
+            continue;
+        if (ce->accessed){
+            ce->accessed = false;
+            continue;
+        }
+        return ce;
+    }
+    return NULL; //#A all pinned
+}
+//@4-1 F: pick_victim_2q
+static struct cache_entry *pick_victim_2q(void){
+    struct cache_entry *ce = NULL;
+    if (a1in_cnt > CACHE_A1IN_SIZE || list_empty(&am_list))
+        ce = first_unpinned(&a1in_list);
+    if (ce != NULL)
+        return ce;
+    ce = first_unpinned(&am_list);
+    if (ce == NULL)
+        ce = first_unpinned(&a1in_list);
+    return ce;
+}
+//@4-1 F: pick_victim, hold arr_lock_cache
+static struct cache_entry *pick_victim(void){
+    if (cache_policy == CACHE_2Q)
+        return pick_victim_2q();
+    return pick_victim_clock();
+}
+//@4-1 F: dirty_sync, put CE on cache_dirty_list iff dirty
+//#A hold arr_lock_cache; every change of dirty is followed by this
+static void dirty_sync(struct cache_entry *ce){
+    if (ce->dirty && !ce->in_dirty_list){
+        list_push_back(&cache_dirty_list, &ce->dirty_elem);
+        ce->in_dirty_list = true;
+        if (++dirty_cnt == CACHE_DIRTY_THRESHOLD) //#A once per crossing
+            sema_up(&flush_wake);
+    }
+    else if (!ce->dirty && ce->in_dirty_list){
+        list_remove(&ce->dirty_elem);
+        ce->in_dirty_list = false;
+        dirty_cnt--;
+    }
+}
+//@4-1 F: sector_less, for sorting write-back
+static bool sector_less(const struct list_elem *a, const struct list_elem *b,
+                        void *aux UNUSED){
+    return list_entry(a, struct cache_entry, flush_elem)->sector
+           < list_entry(b, struct cache_entry, flush_elem)->sector;
+}
+//@4-1 F: cache_forget, CE loses its sector, hold arr_lock_cache
+static void cache_forget(struct cache_entry *ce){
+    hash_delete(&cache_index, &ce->hash_elem);
+    queue_remove(ce);
+    ASSERT(!ce->dirty);
+    dirty_sync(ce);
+    if (ce->read_ahead){ //#A prefetched, never used
+        ra_wasted_cnt++;
+        ce->read_ahead = false;
+    }
+}
 //@4-1 F: cache_very_init
 void cache_very_init(){
     lock_init(&arr_lock_cache);
+    cond_init(&cache_unpinned);
+    hash_init(&cache_index, cache_hash, cache_less, NULL);
+    list_init(&cache_free_list);
+    list_init(&a1in_list);
+    list_init(&am_list);
+    list_init(&cache_dirty_list);
+    sema_init(&flush_wake, 0);
     for (int i = 0; i < CACHE_MAX_SIZE; i++){
         cache[i].valid = false; //#A most-important
         cache[i].sector = -1;
         cache[i].dirty = false;
         cache[i].open_cnt = 0;
+        cache[i].accessed = false;
+        cache[i].queue = CACHE_Q_NONE;
+        cache[i].read_ahead = false;
+        cache[i].in_dirty_list = false;
+        cache[i].held_txn = 0;
+        cache[i].owner = -1;
+        lock_init(&cache[i].entry_lock);
+        list_push_back(&cache_free_list, &cache[i].free_elem);
     }
     //@4-1 flush-thread
     thread_create("cache_flushing", PRI_DEFAULT, for_cache_flush_thread, NULL);
+    thread_create("cache_flush_timer", PRI_DEFAULT,
+                  for_cache_flush_timer_thread, NULL);
+    //@4-1 read-ahead-thread
+    lock_init(&ra_lock);
+    cond_init(&ra_ready);
+    thread_create("cache_read_ahead", PRI_DEFAULT,
+                  for_cache_read_ahead_thread, NULL);
 }
-//@4-1 F: get_entry_cache
-int get_entry_cache(block_sector_t sector){
+//@4-1 F: cache_evict, clean unpinned victim CE loses its sector
+//#A hold arr_lock_cache
+static void cache_evict(struct cache_entry *ce){
+    //@4-1 C: 2Q ghost only once really evicted, a dirty victim is
+    //#A written back first and may be picked again
+    if (ce->queue == CACHE_Q_A1IN)
+        a1out_push(ce->sector); //#A remember, in case it comes back
+    cache_forget(ce);
+    evict_cnt++;
+}
+//@4-1 F: cache_claim, free CE now holds SECTOR, not loaded yet
+//#A hold arr_lock_cache; CE comes back pinned, entry_lock held
+static void cache_claim(struct cache_entry *ce, block_sector_t sector,
+                        bool demand){
+    ce->valid = true; 
+    ce->sector = sector;
+    ce->dirty = false;
+    ce->owner = -1;
+    ce->open_cnt = 1;
+    ce->read_ahead = !demand;
+    hash_insert(&cache_index, &ce->hash_elem);
+    cache_place(ce);
+    lock_acquire(&ce->entry_lock); //#A never blocks, it was unpinned
+}
+//@4-1 F: cache_lookup, DEMAND is false for read-ahead
+//@4-3 C: no disk I/O under arr_lock_cache; returns pinned, entry_lock held
+//@4-2 C: LOAD is false when the caller overwrites all of data anyway
+//@4-1 C: *MISSP (if not null) tells if SECTOR was newly given an entry
+static struct cache_entry *cache_lookup(block_sector_t sector, bool demand,
+                                        bool load, bool *missp){
     ASSERT(sector != -1);
+    bool missed = false;
     lock_acquire(&arr_lock_cache);
-    //#A already existed
-    for (int i = 0; i < CACHE_MAX_SIZE; i++)
-        if (cache[i].sector == sector && cache[i].valid == true){
-            cache[i].open_cnt += 1;
+    while (true){
+        //#A already existed, O(1) by cache_index
+        struct cache_entry *ce = cache_find(sector);
+        if (ce != NULL){
+            ce->open_cnt += 1;
+            if (demand){
+                cache_touch(ce);
+                if (!missed)
+                    cache_hit_cnt++;
+                if (ce->read_ahead){
+                    ra_used_cnt++;
+                    ce->read_ahead = false;
+                }
+            }
             lock_release(&arr_lock_cache);
-            return i;
+            lock_acquire(&ce->entry_lock); //#A wait, if someone loading it
+            if (!ce->valid){ //@4-1 C: a direct I/O placeholder, dropped
+                release_entry_cache(ce - cache, false);
+                lock_acquire(&arr_lock_cache);
+                continue;
+            }
+            ASSERT(ce->sector == sector);
+            if (missp != NULL)
+                *missp = false;
+            return ce;
         }
-    //#A not existed
-    //#A find free
-    for (int i = 0; i < CACHE_MAX_SIZE; i++){
-        if (cache[i].valid == false){ //#A OK ??
+        if (!missed && demand)
+            cache_miss_cnt++;
+        missed = true;
+        //#A not existed
+        //#A find free, O(1) by cache_free_list
+        if (!list_empty(&cache_free_list)){
+            ce = list_entry(list_pop_front(&cache_free_list),
+                            struct cache_entry, free_elem);
+            ASSERT(ce->valid == false);
+        }
+        else{ //#A evict, by cache_policy
+            ce = pick_victim();
+            if (ce == NULL){ //#A all pinned, wait and look again
+                cond_wait(&cache_unpinned, &arr_lock_cache);
+                continue;
+            }
+            if (ce->dirty == true){
+                //#A write back outside arr_lock_cache, then look again,
+                //#A since SECTOR may be loaded by others meanwhile
+                ASSERT(ce->sector != -1);
+                ce->open_cnt++;
+                evict_write_cnt++;
+                lock_release(&arr_lock_cache);
+                lock_acquire(&ce->entry_lock);
+                if (ce->dirty){
+                    block_write(fs_device, ce->sector, ce->data);
+                    ce->dirty = false;
+                }
+                release_entry_cache(ce - cache, false);
+                lock_acquire(&arr_lock_cache);
+                continue;
+            }
+            cache_evict(ce);
+        }
+        cache_claim(ce, sector, demand);
+        lock_release(&arr_lock_cache);
 
-            cache[i].valid = true; 
-            cache[i].sector = sector;
-            cache[i].dirty = false;
-            cache[i].open_cnt = 1;
-            block_read(fs_device, sector, cache[i].data);
+        if (load)
+            block_read(fs_device, sector, ce->data);
+        if (missp != NULL)
+            *missp = true;
+        return ce;
+    }
+}
+//@4-1 F: get_entry_cache
+int get_entry_cache(block_sector_t sector){
+    return cache_lookup(sector, true, true, NULL) - cache;
+}
+//@4-1 F: get_entry_cache_write, the caller overwrites all of data
+//#A on a miss nothing is read from disk; entry_lock hides the stale data
+int get_entry_cache_write(block_sector_t sector){
+    return cache_lookup(sector, true, false, NULL) - cache;
+}
+//@4-3 F: release_entry_cache
+void release_entry_cache(int cidx, bool dirty){
+    struct cache_entry *ce = &cache[cidx];
+    ASSERT(lock_held_by_current_thread(&ce->entry_lock));
+    if (dirty)
+        ce->dirty = true;
+    lock_release(&ce->entry_lock);
 
-            lock_release(&arr_lock_cache);
-            return i;
-        }
+    lock_acquire(&arr_lock_cache);
+    dirty_sync(ce);
+    ASSERT(ce->open_cnt > 0);
+    if (--ce->open_cnt == 0){
+        if (!ce->valid) //@4-1 C: dropped while others waited on it
+            list_push_back(&cache_free_list, &ce->free_elem);
+        cond_broadcast(&cache_unpinned, &arr_lock_cache);
     }
-    //#A evict, with i random
-    for(int i = sector % CACHE_MAX_SIZE; ; i = (i + 1) % CACHE_MAX_SIZE){
-        if (cache[i].open_cnt > 0)
-            continue;
-        
-        if (cache[i].valid == true && cache[i].dirty == true){
-            ASSERT(cache[i].sector != -1);
-            block_write(fs_device, cache[i].sector, cache[i].data);
+    lock_release(&arr_lock_cache);
+}
+//@4-1 F: cache_drop, CE (pinned, locked, clean) gives up its sector
+//#A back on cache_free_list when the last pin goes; its sector was
+//#A direct I/O, counted here under arr_lock_cache like the others
+static void cache_drop(struct cache_entry *ce){
+    lock_acquire(&arr_lock_cache);
+    direct_cnt++;
+    ce->read_ahead = false; //#A not a wasted prefetch
+    cache_forget(ce);
+    ce->valid = false;
+    ce->sector = -1;
+    lock_release(&arr_lock_cache);
+    release_entry_cache(ce - cache, false);
+}
+//@4-1 F: cache_read_direct, whole SECTOR into BUFFER, not kept cached
+//@4-1 C: a cached copy (maybe dirty) wins; else the disk, straight to
+//#A BUFFER, under a placeholder entry so nobody loads SECTOR meanwhile
+void cache_read_direct(block_sector_t sector, void *buffer){
+    bool miss;
+    struct cache_entry *ce = cache_lookup(sector, false, false, &miss);
+    if (miss){
+        block_read(fs_device, sector, buffer);
+        cache_drop(ce);
+    }
+    else{
+        memcpy(buffer, ce->data, BLOCK_SECTOR_SIZE);
+        release_entry_cache(ce - cache, false);
+    }
+}
+//@4-1 F: cache_write_direct, whole SECTOR from BUFFER, like read_direct
+void cache_write_direct(block_sector_t sector, const void *buffer,
+                        block_sector_t owner){
+    bool miss;
+    struct cache_entry *ce = cache_lookup(sector, false, false, &miss);
+    if (miss){
+        block_write(fs_device, sector, buffer);
+        cache_drop(ce);
+    }
+    else{ //#A keep the cached copy coherent, write-back as usual
+        memcpy(ce->data, buffer, BLOCK_SECTOR_SIZE);
+        ce->owner = owner;
+        release_entry_cache(ce - cache, true);
+    }
+}
+//@4-1 F: cache_read_at
+void cache_read_at(block_sector_t sector, void *buffer, size_t ofs,
+                   size_t size){
+    ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+    int cidx = get_entry_cache(sector);
+    memcpy(buffer, cache[cidx].data + ofs, size);
+    release_entry_cache(cidx, false);
+}
+//@4-1 F: cache_write_at
+void cache_write_at(block_sector_t sector, const void *buffer, size_t ofs,
+                    size_t size, block_sector_t owner){
+    ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+    int cidx = size == BLOCK_SECTOR_SIZE ? get_entry_cache_write(sector)
+                                         : get_entry_cache(sector);
+    memcpy(cache[cidx].data + ofs, buffer, size);
+    cache[cidx].owner = owner;
+    release_entry_cache(cidx, true);
+}
+//@4-2 F: cache_zero, SECTOR becomes all zeros without reading the disk
+//@4-2 C: META logs it, for a new indirect block
+void cache_zero(block_sector_t sector, bool meta, block_sector_t owner){
+    struct cache_entry *ce = cache_lookup(sector, true, false, NULL);
+    memset(ce->data, 0, BLOCK_SECTOR_SIZE);
+    ce->owner = owner;
+    if (meta)
+        journal_log(ce - cache);
+    release_entry_cache(ce - cache, true);
+}
+//@4-2 F: cache_write_meta
+void cache_write_meta(block_sector_t sector, const void *buffer, size_t ofs,
+                      size_t size, block_sector_t owner){
+    ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+    int cidx = size == BLOCK_SECTOR_SIZE ? get_entry_cache_write(sector)
+                                         : get_entry_cache(sector);
+    memcpy(cache[cidx].data + ofs, buffer, size);
+    cache[cidx].owner = owner;
+    journal_log(cidx);
+    release_entry_cache(cidx, true);
+}
+//@4-1 F: cache_write_run, RUN[0..N) are adjacent, pinned, entry_lock held
+//#A written in one request, then cleaned and released
+void cache_write_run(struct cache_entry *run[], size_t n){
+    const void *bufs[CACHE_MAX_SIZE];
+    ASSERT(n <= CACHE_MAX_SIZE);
+    if (n == 0)
+        return;
+    for (size_t i = 0; i < n; i++)
+        bufs[i] = run[i]->data;
+    block_write_multi(fs_device, run[0]->sector, n, bufs);
+    for (size_t i = 0; i < n; i++){
+        run[i]->dirty = false;
+        release_entry_cache(run[i] - cache, false);
+    }
+}
+//@4-1 S: flush_io, runs of one flush_cache in flight on the device queue
+#define FLUSH_DEPTH 8
+struct flush_io{
+    struct cache_entry *ent[CACHE_MAX_SIZE]; //#A locked, in sector order
+    void *bufs[CACHE_MAX_SIZE];
+    size_t n, run_start;                     //#A ent[run_start..n) not sent
+    struct block_request req[FLUSH_DEPTH];
+    size_t req_first[FLUSH_DEPTH];           //#A index into ent
+    size_t issued, retired;
+    size_t written;                          //#A sectors, for the stats
+};
+//@4-1 F: flush_retire, oldest request done -> entries clean, released
+static void flush_retire(struct flush_io *f){
+    size_t k = f->retired++ % FLUSH_DEPTH;
+    block_wait(&f->req[k]);
+    for (size_t i = 0; i < f->req[k].cnt; i++){
+        struct cache_entry *ce = f->ent[f->req_first[k] + i];
+        ce->dirty = false;
+        release_entry_cache(ce - cache, false);
+    }
+}
+//@4-1 F: flush_submit, send ent[run_start..n) without waiting for it
+static void flush_submit(struct flush_io *f){
+    if (f->n == f->run_start)
+        return;
+    if (f->issued - f->retired == FLUSH_DEPTH)
+        flush_retire(f);
+    size_t k = f->issued++ % FLUSH_DEPTH;
+    f->req[k].sector = f->ent[f->run_start]->sector;
+    f->req[k].cnt = f->n - f->run_start;
+    f->req[k].buffers = &f->bufs[f->run_start];
+    f->req[k].write = true;
+    f->req_first[k] = f->run_start;
+    f->written += f->req[k].cnt;
+    block_submit(fs_device, &f->req[k]);
+    f->run_start = f->n;
+}
+//@4-1 F: flush_take, CE off cache_dirty_list into BATCH, pinned
+//#A hold arr_lock_cache
+static void flush_take(struct list *batch, struct cache_entry *ce){
+    list_remove(&ce->dirty_elem);
+    ce->in_dirty_list = false;
+    dirty_cnt--;
+    ce->open_cnt++; //#A pinned until written
+    list_push_back(batch, &ce->flush_elem);
+}
+//@4-1 F: flush_batch, write back the entries flush_take put in BATCH
+//@4-3 C: write back pinned, outside arr_lock_cache
+//@4-1 C: adjacent sectors go out as one request, several in flight
+static void flush_batch(struct list *batch){
+    list_sort(batch, sector_less, NULL);
+    struct flush_io *f = malloc(sizeof *f);
+    if (f == NULL)
+        PANIC("flush_cache: out of memory");
+    f->n = f->run_start = f->issued = f->retired = f->written = 0;
+    while (!list_empty(batch)){
+        struct cache_entry *ce = list_entry(list_pop_front(batch),
+                                            struct cache_entry, flush_elem);
+        if (f->n > f->run_start && ce->sector != f->ent[f->n - 1]->sector + 1)
+            flush_submit(f);
+        lock_acquire(&ce->entry_lock); //#A ascending sector order
+        if (ce->dirty && ce->held_txn == 0){ //@4-2 C: held waits for commit
+            f->ent[f->n] = ce;
+            f->bufs[f->n++] = ce->data;
+        }
+        else{
+            release_entry_cache(ce - cache, false);
+            flush_submit(f);
         }
-        cache[i].valid = true; 
-        cache[i].sector = sector;
-        cache[i].dirty = false;
-        cache[i].open_cnt = 1;
-        block_read(fs_device, sector, &cache[i].data);
-
-        lock_release(&arr_lock_cache);
-        return i;           
     }
-    PANIC("cache-get-entry bottom, no reach\n");
+    flush_submit(f);
+    while (f->retired < f->issued)
+        flush_retire(f);
+    lock_acquire(&arr_lock_cache);
+    flush_write_cnt += f->written;
+    lock_release(&arr_lock_cache);
+    free(f);
+    return;
 }
 //@4-1 F: flush_cache
+//@4-1 C: only dirty entries, sorted by sector; clean data stays resident
 void flush_cache(){
+    struct list batch;
+    list_init(&batch);
+
     lock_acquire(&arr_lock_cache);
-    for (int i = 0; i < CACHE_MAX_SIZE; i++){
-        if(cache[i].valid == true && cache[i].dirty == true){
-            block_write(fs_device, cache[i].sector, &cache[i].data);
-            cache[i].dirty = false;
+    while (!list_empty(&cache_dirty_list))
+        flush_take(&batch, list_entry(list_front(&cache_dirty_list),
+                                      struct cache_entry, dirty_elem));
+    lock_release(&arr_lock_cache);
+    flush_batch(&batch);
+}
+//@4-1 F: cache_flush_owner
+//@4-1 C: the dirty entries of inode OWNER only, the rest stay behind;
+//#A held ones wait for the journal commit, as in flush_cache
+void cache_flush_owner(block_sector_t owner){
+    struct list batch;
+    struct list_elem *e, *next;
+    list_init(&batch);
+
+    lock_acquire(&arr_lock_cache);
+    for (e = list_begin(&cache_dirty_list); e != list_end(&cache_dirty_list);
+         e = next){
+        struct cache_entry *ce = list_entry(e, struct cache_entry, dirty_elem);
+        next = list_next(e);
+        if (ce->owner == owner)
+            flush_take(&batch, ce);
+    }
+    lock_release(&arr_lock_cache);
+    flush_batch(&batch);
+}
+
+//@4-1 F: cache_grab, an unloaded entry for read-ahead of SECTOR
+//@4-1 C: never waits: NULL if SECTOR is cached already, or if getting
+//#A an entry means a write-back or waiting for an unpin.  So the
+//#A read-ahead thread only ever holds entry_locks of entries nobody
+//#A else can reach yet, and never waits while holding them
+static struct cache_entry *cache_grab(block_sector_t sector){
+    struct cache_entry *ce = NULL;
+    lock_acquire(&arr_lock_cache);
+    if (cache_find(sector) == NULL){
+        if (!list_empty(&cache_free_list))
+            ce = list_entry(list_pop_front(&cache_free_list),
+                            struct cache_entry, free_elem);
+        else if ((ce = pick_victim()) != NULL){
+            if (ce->dirty)
+                ce = NULL;
+            else
+                cache_evict(ce);
         }
-        if(cache[i].open_cnt == 0)
-            cache[i].valid = false;
+        if (ce != NULL)
+            cache_claim(ce, sector, false);
     }
     lock_release(&arr_lock_cache);
-    return;
+    return ce;
+}
+//@4-1 F: cache_read_ahead
+void cache_read_ahead(block_sector_t sector){
+    lock_acquire(&ra_lock);
+    if (ra_cnt < CACHE_RA_QUEUE_SIZE){ //#A full, just drop it
+        ra_queue[(ra_head + ra_cnt) % CACHE_RA_QUEUE_SIZE] = sector;
+        ra_cnt++;
+        cond_signal(&ra_ready, &ra_lock);
+    }
+    lock_release(&ra_lock);
+}
+
+//@4-1 F: cache_set_policy, for -cache=NAME; false if NAME unknown
+bool cache_set_policy(const char *name){
+    if (name == NULL)
+        return false;
+    if (!strcmp(name, "clock"))
+        cache_policy = CACHE_CLOCK;
+    else if (!strcmp(name, "2q"))
+        cache_policy = CACHE_2Q;
+    else
+        return false;
+    return true;
+}
+//@4-1 F: cache_get_stats, the cache part of *ST
+void cache_get_stats(struct fsstats *st){
+    lock_acquire(&arr_lock_cache);
+    st->cache_hits = cache_hit_cnt;
+    st->cache_misses = cache_miss_cnt;
+    st->cache_evictions = evict_cnt;
+    st->cache_evict_writes = evict_write_cnt;
+    st->cache_flush_writes = flush_write_cnt;
+    st->ra_used = ra_used_cnt;
+    st->ra_wasted = ra_wasted_cnt;
+    st->direct = direct_cnt;
+    lock_release(&arr_lock_cache);
+}
+//@4-1 F: cache_print_stats
+void cache_print_stats(void){
+    printf("Cache (%s): %llu hits, %llu misses\n",
+           cache_policy == CACHE_2Q ? "2q" : "clock",
+           cache_hit_cnt, cache_miss_cnt);
+    printf("Cache: %llu evictions (%llu written back), "
+           "%llu sectors flushed\n",
+           evict_cnt, evict_write_cnt, flush_write_cnt);
+    printf("Read-ahead: %llu sectors used, %llu wasted\n",
+           ra_used_cnt, ra_wasted_cnt);
+    printf("Direct I/O: %llu sectors\n", direct_cnt);
 }
+
 //@4-4 F: for_cache_flush_thread
+//@4-1 C: woken by the timer, or early by CACHE_DIRTY_THRESHOLD
 void for_cache_flush_thread(void *aux UNUSED){
     while (true){
-        timer_sleep(TIMER_FREQ);
+        sema_down(&flush_wake);
+        journal_commit(); //@4-2 in: for_cache_flush_thread
         flush_cache();
     }
 }
+//@4-1 F: for_cache_flush_timer_thread
+void for_cache_flush_timer_thread(void *aux UNUSED){
+    while (true){
+        timer_sleep(TIMER_FREQ);
+        sema_up(&flush_wake);
+    }
+}
+//@4-1 F: for_cache_read_ahead_thread
+void for_cache_read_ahead_thread(void *aux UNUSED){
+    while (true){
+        lock_acquire(&ra_lock);
+        while (ra_cnt == 0)
+            cond_wait(&ra_ready, &ra_lock);
+        block_sector_t sector = ra_queue[ra_head];
+        ra_head = (ra_head + 1) % CACHE_RA_QUEUE_SIZE;
+        ra_cnt--;
+
+        //@4-1 C: and the sectors right after it, as one request
+        block_sector_t secs[CACHE_RA_MAX];
+        size_t cnt = 1;
+        secs[0] = sector;
+        while (cnt < CACHE_RA_MAX && ra_cnt > 0
+               && ra_queue[ra_head] == secs[cnt - 1] + 1){
+            secs[cnt++] = ra_queue[ra_head];
+            ra_head = (ra_head + 1) % CACHE_RA_QUEUE_SIZE;
+            ra_cnt--;
+        }
+        lock_release(&ra_lock);
+
+        struct cache_entry *run[CACHE_RA_MAX];
+        void *bufs[CACHE_RA_MAX];
+        size_t n = 0;
+        for (size_t i = 0; i <= cnt; i++){
+            struct cache_entry *ce = i < cnt ? cache_grab(secs[i]) : NULL;
+            if (ce != NULL){ //#A unloaded, entry_lock held
+                run[n] = ce;
+                bufs[n++] = ce->data;
+                continue;
+            }
+            //#A cached already, no entry to spare, or the end: read
+            //#A what we have
+            block_read_multi(fs_device, n > 0 ? run[0]->sector : 0, n, bufs);
+            for (size_t j = 0; j < n; j++)
+                release_entry_cache(run[j] - cache, false);
+            n = 0;
+        }
+    }
+}
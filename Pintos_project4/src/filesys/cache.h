@@ -2,28 +2,108 @@
 #define CACHE_H
 //@4-1 #include
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
 #include "devices/block.h"
 #include "threads/synch.h"
+#include <fsstats.h>
 #define CACHE_MAX_SIZE 64
+//@4-1 Global-Val, replacement
+#define CACHE_A1IN_SIZE (CACHE_MAX_SIZE / 4)  //#A 2Q: Kin
+#define CACHE_A1OUT_SIZE (CACHE_MAX_SIZE / 2) //#A 2Q: Kout, ghost sectors
+//@4-1 Global-Val, write-behind
+#define CACHE_DIRTY_THRESHOLD (CACHE_MAX_SIZE / 2) //#A flush early above it
+//@4-1 Global-Val, read-ahead
+#define CACHE_RA_QUEUE_SIZE 64 //#A pending prefetch sectors, drop if full
+#define CACHE_RA_MAX 16        //#A largest read-ahead window, in sectors
+//@4-1 S: cache_policy
+enum cache_policy{
+    CACHE_CLOCK,    //#A second-chance, accessed bit (default)
+    CACHE_2Q        //#A scan-resistant, A1in FIFO + A1out ghost + Am LRU
+};
+//@4-1 S: cache_queue, which 2Q list the entry is on
+enum cache_queue{
+    CACHE_Q_NONE,
+    CACHE_Q_A1IN,
+    CACHE_Q_AM
+};
 //@4-1 S: cache_entry
 struct cache_entry{
     block_sector_t sector;
     bool valid;
     uint32_t open_cnt;    //#C whether the cache is in use
     bool dirty; //#A write-back now, no-use
-    uint8_t data[BLOCK_SECTOR_SIZE];
+    uint8_t data[BLOCK_SECTOR_SIZE] __attribute__ ((aligned (4))); //#A DMA
+    //@4-3 in: cache_entry
+    struct lock entry_lock;     //#A data & I/O of this entry, pin first
+    //@4-1 in: cache_entry, index
+    struct hash_elem hash_elem; //#A in cache_index, iff valid
+    struct list_elem free_elem; //#A in cache_free_list, iff !valid
+    //@4-1 in: cache_entry, replacement
+    bool accessed;              //#A clock: second chance
+    enum cache_queue queue;     //#A 2Q: on a1in or am, iff valid
+    struct list_elem q_elem;
+    //@4-1 in: cache_entry, write-behind
+    bool in_dirty_list;         //#A on cache_dirty_list, by arr_lock_cache
+    struct list_elem dirty_elem;
+    struct list_elem flush_elem; //#A in a flush_cache batch, while pinned
+    //@4-1 in: cache_entry, read-ahead
+    bool read_ahead;            //#A loaded by prefetch, no demand hit yet
+    //@4-2 in: cache_entry, journal
+    uint32_t held_txn;          //#A != 0: logged, stays until that commit
+    //@4-1 in: cache_entry, fsync
+    block_sector_t owner;       //#A inode the sector belongs to, -1 unknown
 };
 //@4-1 Global-Val
 struct cache_entry cache[CACHE_MAX_SIZE]; //#A OK ??
 struct lock arr_lock_cache; //#A Don't, when holding any cache_lock
+                            //#A except entry_lock of an unpinned entry
+//@4-1 Global-Val, set by -cache=clock|2q
+extern enum cache_policy cache_policy;
 
 //@4-1 F: cache_very_init
 void cache_very_init(void);
 //@4-1 F: get_entry_cache
-int get_entry_cache(block_sector_t sector);
+int get_entry_cache(block_sector_t sector); //#A pinned & entry_lock held
+//@4-1 F: get_entry_cache_write, as get_entry_cache, no read on a miss
+int get_entry_cache_write(block_sector_t sector);
+//@4-3 F: release_entry_cache
+void release_entry_cache(int cidx, bool dirty);
+//@4-1 F: cache_read_at, SIZE bytes at OFS of SECTOR, through the cache
+void cache_read_at(block_sector_t sector, void *buffer, size_t ofs,
+                   size_t size);
+//@4-1 F: cache_write_at, OWNER: inode SECTOR belongs to, for fsync
+void cache_write_at(block_sector_t sector, const void *buffer, size_t ofs,
+                    size_t size, block_sector_t owner);
+//@4-1 F: cache_read_direct, a whole sector, bypassing the cache if absent
+void cache_read_direct(block_sector_t sector, void *buffer);
+//@4-1 F: cache_write_direct
+void cache_write_direct(block_sector_t sector, const void *buffer,
+                        block_sector_t owner);
+//@4-2 F: cache_zero, a freshly allocated sector, dirty, no disk read
+void cache_zero(block_sector_t sector, bool meta, block_sector_t owner);
+//@4-2 F: cache_write_meta, cache_write_at + journal_log
+void cache_write_meta(block_sector_t sector, const void *buffer, size_t ofs,
+                      size_t size, block_sector_t owner);
+//@4-1 F: cache_write_run, write back adjacent pinned & locked entries
+void cache_write_run(struct cache_entry *run[], size_t n);
 //@4-1 F: flush_cache
 void flush_cache();
+//@4-1 F: cache_flush_owner, flush_cache for the sectors of one inode
+void cache_flush_owner(block_sector_t owner);
+//@4-1 F: cache_read_ahead, queue SECTOR for the read-ahead daemon
+void cache_read_ahead(block_sector_t sector);
+//@4-1 F: cache_set_policy
+bool cache_set_policy(const char *name);
+//@4-1 F: cache_get_stats
+void cache_get_stats(struct fsstats *);
+//@4-1 F: cache_print_stats
+void cache_print_stats(void);
 //@4-4 F: for_cache_flush_thread
 void for_cache_flush_thread(void *);
+//@4-1 F: for_cache_flush_timer_thread
+void for_cache_flush_timer_thread(void *);
+//@4-1 F: for_cache_read_ahead_thread
+void for_cache_read_ahead_thread(void *);
 
 #endif 
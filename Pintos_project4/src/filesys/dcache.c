@@ -0,0 +1,93 @@
+//@4-4 #include
+#include "filesys/dcache.h"
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/synch.h"
+
+//@4-4 S: dcache_entry
+struct dcache_entry{
+    bool valid;
+    block_sector_t parent;      //#A inode sector of the directory
+    char name[NAME_MAX + 1];
+    block_sector_t sector;      //#A 0: NAME is known not to exist
+    unsigned gen;               //#A bumped by dcache_invalidate
+};
+//@4-4 Global-Val
+static struct dcache_entry dcache[DCACHE_SIZE];
+static struct lock dcache_lock;
+static unsigned long long dcache_hit_cnt, dcache_neg_hit_cnt;
+static unsigned long long dcache_miss_cnt;
+
+//@4-4 F: dcache_slot
+static struct dcache_entry *dcache_slot(block_sector_t parent,
+                                        const char *name){
+    unsigned h = hash_string(name) ^ hash_int(parent);
+    return &dcache[h % DCACHE_SIZE];
+}
+//@4-4 F: dcache_match, hold dcache_lock
+static bool dcache_match(const struct dcache_entry *de, block_sector_t parent,
+                         const char *name){
+    return de->valid && de->parent == parent && !strcmp(de->name, name);
+}
+//@4-4 F: dcache_init
+void dcache_init(void){
+    lock_init(&dcache_lock);
+    for (int i = 0; i < DCACHE_SIZE; i++){
+        dcache[i].valid = false;
+        dcache[i].gen = 0;
+    }
+}
+//@4-4 F: dcache_lookup
+bool dcache_lookup(block_sector_t parent, const char *name,
+                   block_sector_t *sectorp, unsigned *genp){
+    struct dcache_entry *de = dcache_slot(parent, name);
+    bool hit = false;
+    lock_acquire(&dcache_lock);
+    *genp = de->gen;
+    if (dcache_match(de, parent, name)){
+        hit = true;
+        *sectorp = de->sector;
+        if (de->sector == 0)
+            dcache_neg_hit_cnt++;
+        else
+            dcache_hit_cnt++;
+    }
+    else
+        dcache_miss_cnt++;
+    lock_release(&dcache_lock);
+    return hit;
+}
+//@4-4 F: dcache_insert, replaces whatever was in the slot
+//#A unless invalidated since the lookup that returned GEN: then the
+//#A directory was read before a dir_add / dir_remove, and is stale
+void dcache_insert(block_sector_t parent, const char *name,
+                   block_sector_t sector, unsigned gen){
+    if (strlen(name) > NAME_MAX)
+        return;
+    struct dcache_entry *de = dcache_slot(parent, name);
+    lock_acquire(&dcache_lock);
+    if (de->gen != gen){
+        lock_release(&dcache_lock);
+        return;
+    }
+    de->valid = true;
+    de->parent = parent;
+    strlcpy(de->name, name, sizeof de->name);
+    de->sector = sector;
+    lock_release(&dcache_lock);
+}
+//@4-4 F: dcache_invalidate
+void dcache_invalidate(block_sector_t parent, const char *name){
+    struct dcache_entry *de = dcache_slot(parent, name);
+    lock_acquire(&dcache_lock);
+    if (dcache_match(de, parent, name))
+        de->valid = false;
+    de->gen++; //#A even if not there yet: a lookup may be about to put it
+    lock_release(&dcache_lock);
+}
+//@4-4 F: dcache_print_stats
+void dcache_print_stats(void){
+    printf("Name cache: %llu hits, %llu negative hits, %llu misses\n",
+           dcache_hit_cnt, dcache_neg_hit_cnt, dcache_miss_cnt);
+}
@@ -0,0 +1,25 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+//@4-4 #include
+#include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/directory.h"
+//@4-4 Global-Val, name cache
+#define DCACHE_SIZE 128 //#A direct-mapped by hash of (parent, name)
+
+//@4-4 F: dcache_init
+void dcache_init(void);
+//@4-4 F: dcache_lookup, true if cached; *SECTORP = 0 for "no such name"
+//#A *GENP: the slot's generation, for dcache_insert after a miss
+bool dcache_lookup(block_sector_t parent, const char *name,
+                   block_sector_t *sectorp, unsigned *genp);
+//@4-4 F: dcache_insert, SECTOR = 0 records a miss (negative entry)
+//#A dropped if the slot was invalidated since GEN
+void dcache_insert(block_sector_t parent, const char *name,
+                   block_sector_t sector, unsigned gen);
+//@4-4 F: dcache_invalidate, on dir_add / dir_remove of NAME in PARENT
+void dcache_invalidate(block_sector_t parent, const char *name);
+//@4-4 F: dcache_print_stats
+void dcache_print_stats(void);
+
+#endif
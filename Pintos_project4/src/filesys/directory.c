@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+//@4-4 #include
+#include <hash.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -21,11 +24,86 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+//@4-4 Global-Val, hashed directory
+/* A directory file is a header sector followed by bucket sectors
+   (extendible hashing).  The header's table maps the low DEPTH bits
+   of a name's hash to the logical sector of its bucket.  A bucket
+   that can't split any more grows a chain of overflow buckets.  An
+   all-zero file is a valid empty directory.
+   The table fits in the one header sector, so DEPTH stops at
+   DIR_DEPTH_MAX: up to 128 buckets, about 3200 evenly hashed
+   entries.  Past that, lookups scan overflow chains, which grow
+   linearly with the directory. */
+#define DIR_DEPTH_MAX 7
+#define DIR_TABLE_MAX (1 << DIR_DEPTH_MAX)
+#define DIR_BUCKET_ENTS 25
+
+//@4-4 S: dir_header, logical sector 0
+struct dir_header
+  {
+    uint32_t depth;                     /* Global depth, bits of hash. */
+    uint32_t bucket_cnt;                /* Buckets are sectors 1..cnt. */
+    uint16_t table[DIR_TABLE_MAX];      /* 0: no bucket yet. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8 - 2 * DIR_TABLE_MAX];
+  };
+
+//@4-4 S: dir_bucket, logical sectors 1..
+struct dir_bucket
+  {
+    uint16_t depth;                     /* Local depth. */
+    uint16_t next;                      /* Overflow bucket, 0 if none. */
+    struct dir_entry e[DIR_BUCKET_ENTS];
+    uint8_t unused[BLOCK_SECTOR_SIZE - 4
+                   - DIR_BUCKET_ENTS * sizeof (struct dir_entry)];
+  };
+
+//@4-4 F: entry_ofs, byte offset of entry SLOT of bucket B
+static off_t
+entry_ofs (uint16_t b, int slot)
+{
+  return b * BLOCK_SECTOR_SIZE + offsetof (struct dir_bucket, e)
+         + slot * sizeof (struct dir_entry);
+}
+
+//@4-4 F: read_entry, a short read (past EOF) is a free entry
+static void
+read_entry (struct inode *inode, off_t ofs, struct dir_entry *e)
+{
+  if (inode_read_at (inode, e, sizeof *e, ofs) != sizeof *e)
+    e->in_use = false;
+}
+
+//@4-4 F: bucket_of, first bucket for NAME, 0 if none
+static uint16_t
+bucket_of (struct inode *inode, const char *name)
+{
+  uint32_t depth = 0;
+  uint16_t b = 0;
+  inode_read_at (inode, &depth, sizeof depth,
+                 offsetof (struct dir_header, depth));
+  unsigned idx = hash_string (name) & ((1u << depth) - 1);
+  inode_read_at (inode, &b, sizeof b,
+                 offsetof (struct dir_header, table) + idx * sizeof b);
+  return b;
+}
+
+//@4-4 F: bucket_next, overflow bucket after B, 0 if none
+static uint16_t
+bucket_next (struct inode *inode, uint16_t b)
+{
+  uint16_t next = 0;
+  inode_read_at (inode, &next, sizeof next,
+                 b * BLOCK_SECTOR_SIZE + offsetof (struct dir_bucket, next));
+  return next;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 { 
+  ASSERT (sizeof (struct dir_header) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct dir_bucket) == BLOCK_SECTOR_SIZE);
   //@4-4 C: IC.d.ver , dir_create only use to create root
   return inode_create (sector, entry_cnt * sizeof (struct dir_entry), 
                        true, ROOT_DIR_SECTOR);
@@ -95,25 +173,160 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e; //#A dir's block: dir_entry - dir_entry - ...
-  size_t ofs;
+  struct dir_entry e;
+  uint16_t b;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
+  //@4-4 C: only NAME's bucket chain, not the whole directory
+  for (b = bucket_of (dir->inode, name); b != 0;
+       b = bucket_next (dir->inode, b))
+    for (int slot = 0; slot < DIR_BUCKET_ENTS; slot++)
       {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
+        off_t ofs = entry_ofs (b, slot);
+        read_entry (dir->inode, ofs, &e);
+        if (e.in_use && !strcmp (name, e.name)) 
+          {
+            if (ep != NULL)
+              *ep = e;
+            if (ofsp != NULL)
+              *ofsp = ofs;
+            return true;
+          }
       }
   return false;
 }
 
+//@4-4 F: bucket_split
+/* Splits bucket B of depth DEPTH in two by the next hash bit,
+   doubling the table of HDR first if needed.  HDR is written
+   back.  Returns false on memory or disk error. */
+static bool
+bucket_split (struct inode *inode, struct dir_header *hdr, uint16_t b,
+              uint16_t depth)
+{
+  struct dir_bucket *old = malloc (sizeof *old);
+  struct dir_bucket *new = calloc (1, sizeof *new);
+  bool success = false;
+  if (old == NULL || new == NULL)
+    goto done;
+  memset (old, 0, sizeof *old);
+  inode_read_at (inode, old, sizeof *old, b * BLOCK_SECTOR_SIZE);
+
+  if (depth == hdr->depth) //#A double the table
+    {
+      for (unsigned i = 0; i < (1u << hdr->depth); i++)
+        hdr->table[i + (1u << hdr->depth)] = hdr->table[i];
+      hdr->depth++;
+    }
+  uint16_t nb = ++hdr->bucket_cnt;
+  for (unsigned i = 0; i < (1u << hdr->depth); i++)
+    if (hdr->table[i] == b && (i >> depth & 1))
+      hdr->table[i] = nb;
+
+  old->depth = new->depth = depth + 1;
+  for (int slot = 0; slot < DIR_BUCKET_ENTS; slot++)
+    if (old->e[slot].in_use && (hash_string (old->e[slot].name) >> depth & 1))
+      {
+        new->e[slot] = old->e[slot];
+        old->e[slot].in_use = false;
+      }
+  success = inode_write_at (inode, new, sizeof *new,
+                            nb * BLOCK_SECTOR_SIZE) == sizeof *new
+            && inode_write_at (inode, old, sizeof *old,
+                               b * BLOCK_SECTOR_SIZE) == sizeof *old
+            && inode_write_at (inode, hdr, sizeof *hdr, 0) == sizeof *hdr;
+ done:
+  free (old);
+  free (new);
+  return success;
+}
+
+//@4-4 F: bucket_insert
+/* Puts E into a free slot of its bucket chain, splitting the
+   bucket or chaining an overflow bucket when the chain is full.
+   Returns true if successful.
+   It splits at most DIR_DEPTH_MAX times, so it writes the header,
+   at most DIR_DEPTH_MAX + 2 buckets, and the directory inode with
+   up to 3 indirect blocks as the file grows; with the new file's
+   inode that is JOURNAL_CREATE_MAX. */
+static bool
+bucket_insert (struct inode *inode, const struct dir_entry *e)
+{
+  struct dir_header *hdr = malloc (sizeof *hdr);
+  struct dir_entry slot_e;
+  bool success = false;
+  if (hdr == NULL)
+    return false;
+
+  for (;;)
+    {
+      memset (hdr, 0, sizeof *hdr);
+      inode_read_at (inode, hdr, sizeof *hdr, 0);
+      unsigned idx = hash_string (e->name) & ((1u << hdr->depth) - 1);
+      uint16_t b = hdr->table[idx];
+      if (b == 0) //#A empty directory, first bucket
+        {
+          struct dir_bucket *first = calloc (1, sizeof *first);
+          if (first == NULL)
+            break;
+          b = hdr->table[idx] = ++hdr->bucket_cnt;
+          first->depth = hdr->depth;
+          first->e[0] = *e;
+          success = inode_write_at (inode, first, sizeof *first,
+                                    b * BLOCK_SECTOR_SIZE) == sizeof *first
+                    && inode_write_at (inode, hdr, sizeof *hdr, 0)
+                       == sizeof *hdr;
+          free (first);
+          break;
+        }
+
+      //#A free slot anywhere on the chain
+      uint16_t last = b;
+      for (uint16_t c = b; c != 0; last = c, c = bucket_next (inode, c))
+        for (int slot = 0; slot < DIR_BUCKET_ENTS; slot++)
+          {
+            read_entry (inode, entry_ofs (c, slot), &slot_e);
+            if (!slot_e.in_use)
+              {
+                success = inode_write_at (inode, e, sizeof *e,
+                                          entry_ofs (c, slot)) == sizeof *e;
+                goto done;
+              }
+          }
+
+      uint16_t depth = 0;
+      inode_read_at (inode, &depth, sizeof depth, b * BLOCK_SECTOR_SIZE);
+      if (depth < DIR_DEPTH_MAX)
+        {
+          if (!bucket_split (inode, hdr, b, depth))
+            break;
+          continue; //#A try again with the new table
+        }
+
+      //#A can't split: chain an overflow bucket after LAST
+      struct dir_bucket *over = calloc (1, sizeof *over);
+      if (over == NULL)
+        break;
+      uint16_t nb = ++hdr->bucket_cnt;
+      over->depth = depth;
+      over->e[0] = *e;
+      success = inode_write_at (inode, over, sizeof *over,
+                                nb * BLOCK_SECTOR_SIZE) == sizeof *over
+                && inode_write_at (inode, &nb, sizeof nb,
+                                   last * BLOCK_SECTOR_SIZE
+                                   + offsetof (struct dir_bucket, next))
+                   == sizeof nb
+                && inode_write_at (inode, hdr, sizeof *hdr, 0) == sizeof *hdr;
+      free (over);
+      break;
+    }
+ done:
+  free (hdr);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -123,12 +336,23 @@ dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
   struct dir_entry e;
+  block_sector_t parent, sector;
+  unsigned gen;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  //@4-4 in: dir_lookup, name cache first, then the bucket
+  //#A no directory lock here: a dir_add or dir_remove between lookup()
+  //#A and the insert bumps GEN, and the stale result isn't cached
+  parent = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (parent, name, &sector, &gen))
+    {
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : 0;
+      dcache_insert (parent, name, sector, gen);
+    }
+  if (sector != 0)
+    *inode = inode_open (sector);
   else
     *inode = NULL;
 
@@ -145,7 +369,6 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
-  off_t ofs;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -159,23 +382,15 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file. //#A That's great!
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
   /* Write slot. */
+  //@4-4 C: into NAME's bucket, see bucket_insert
+  memset (&e, 0, sizeof e);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector; //#A write_at may cause grow
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  success = bucket_insert (dir->inode, &e);
+  //@4-4 in: dir_add, drop a negative entry
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
 
  done:
   return success;
@@ -214,6 +429,8 @@ dir_remove (struct dir *dir, const char *name)
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  //@4-4 in: dir_remove
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
 
   /* Remove inode. */
   inode_remove (inode);
@@ -232,16 +449,20 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  //@4-4 C: dir->pos counts entry slots of buckets 1, 2, ...
+  for (;;)
     {
-      dir->pos += sizeof e; //#A dir->pos changed here!
-      if (e.in_use) //#A what about dir's size?
+      uint16_t b = 1 + dir->pos / DIR_BUCKET_ENTS;
+      if (b * BLOCK_SECTOR_SIZE >= inode_length (dir->inode))
+        return false;
+      read_entry (dir->inode, entry_ofs (b, dir->pos % DIR_BUCKET_ENTS), &e);
+      dir->pos++; //#A dir->pos changed here!
+      if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
         } 
     }
-  return false;
 }
 
 //@4-4 F: dir_is_root
@@ -255,14 +476,16 @@ bool dir_is_root(struct dir* dir){
 //@4-4 F: dir_is_empty
 bool dir_is_empty (struct inode *inode){
   struct dir_entry e;
-  off_t pos = 0;
-
-  while (inode_read_at (inode, &e, sizeof e, pos) == sizeof e) {
-    pos += sizeof e;
-    if (e.in_use){
-      return false;
+  uint16_t b;
+
+  //@4-4 C: every bucket, hashed layout
+  for (b = 1; b * BLOCK_SECTOR_SIZE < inode_length (inode); b++)
+    for (int slot = 0; slot < DIR_BUCKET_ENTS; slot++) {
+      read_entry (inode, entry_ofs (b, slot), &e);
+      if (e.in_use){
+        return false;
+      }
     }
-  }
   return true;
 }
 
@@ -9,6 +9,9 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    //@4-1 in: file
+    struct read_ahead ra;       /* Sequential read detection. */
+    bool direct;                /* Whole sectors bypass the cache? */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +26,11 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      //@4-1 in: file_open
+      file->ra.last = -1;
+      file->ra.window = 0;
+      file->ra.queued = 0;
+      file->direct = false;
       return file;
     }
   else
@@ -68,7 +76,15 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+  //@4-1 in: file_read, no prefetch into the cache for direct I/O
+  if (file->direct)
+    bytes_read = inode_read_direct (file->inode, buffer, size, file->pos);
+  else
+    {
+      bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+      inode_read_ahead (file->inode, &file->ra, file->pos, bytes_read);
+    }
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,6 +97,8 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
+  if (file->direct)
+    return inode_read_direct (file->inode, buffer, size, file_ofs);
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
@@ -94,7 +112,7 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written = file_write_at (file, buffer, size, file->pos);
   file->pos += bytes_written; //@4-x entend, here or inode_write_at ?
   return bytes_written;
 }
@@ -110,9 +128,23 @@ off_t
  file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
+  if (file->direct)
+    return inode_write_direct (file->inode, buffer, size, file_ofs);
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+//@4-1 F: file_set_direct
+/* Turns direct I/O on FILE on or off.  With it on, reads and writes
+   of whole, sector-aligned sectors move straight between the
+   caller's buffer and the disk instead of through the buffer
+   cache, which still serves any sector it already holds. */
+void
+file_set_direct (struct file *file, bool direct)
+{
+  ASSERT (file != NULL);
+  file->direct = direct;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
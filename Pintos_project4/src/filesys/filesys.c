@@ -10,6 +10,12 @@
 #include "filesys/cache.h"
 //@4-4 #include
 #include "threads/thread.h"
+#include "filesys/dcache.h"
+//@4-2 #include
+#include "filesys/journal.h"
+//@4-1 #include
+#include <fsstats.h>
+#include "devices/timer.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -26,11 +32,13 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init (); //#A init a list open_node only
+  dcache_init (); //@4-4 in: filesys_init
   free_map_init ();//initialize the free_map, which is a bit_map. Set the 0 and 1 to be true.
 
   if (format) 
     do_format (); //#A clear the bitmap in disk
 
+  journal_init (); //@4-2 in: filesys_init, replay before reading metadata
   free_map_open (); //#A read free_map from Disk
 }
 
@@ -39,12 +47,49 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  //@4-2 C: free map goes into the cache first, committed, then flushed
+  free_map_close ();
+  journal_commit ();
+
   //@4-1 flush
   flush_cache();
-
-  free_map_close (); //@4-x for now only free_map written back
 }
 
+//@4-1 F: filesys_sync
+/* Writes every dirty sector in the buffer cache to disk: the data
+   first, in sector order, then the metadata through a journal
+   commit. */
+void
+filesys_sync (void)
+{
+  flush_cache ();
+  journal_commit ();
+}
+
+//@4-1 F: filesys_get_stats, cache and file system disk counters
+void
+filesys_get_stats (struct fsstats *st)
+{
+  struct block_stats bs;
+  int i;
+
+  memset (st, 0, sizeof *st);
+  st->ticks = timer_ticks ();
+  cache_get_stats (st);
+  block_get_stats (fs_device, &bs);
+  st->sectors_read = bs.read_cnt;
+  st->sectors_written = bs.write_cnt;
+  st->requests = bs.req_cnt;
+  st->transfers = bs.batch_cnt;
+  for (i = 0; i < FSSTATS_LAT_CNT && i < BLOCK_LAT_CNT; i++)
+    {
+      st->read_lat[i] = bs.read_lat[i];
+      st->write_lat[i] = bs.write_lat[i];
+    }
+  for (i = 0; i < FSSTATS_DEPTH_CNT && i < BLOCK_DEPTH_CNT; i++)
+    st->depth[i] = bs.depth[i];
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -55,19 +100,23 @@ filesys_create (const char *name, off_t initial_size, bool is_dir)
   //@4-4 in: filesys_create.1
   struct dir *dir = move_dir(name); //#A return NULL, if wrong; one dir no-existed
   char *file_name = path_to_name(name); //#A file_name need free
+  journal_begin (JOURNAL_CREATE_MAX); //@4-2 in: filesys_create
 
   block_sector_t inode_sector = 0;
   //struct dir *dir = dir_open_root ();//#A root-dir init in do_format, Original
   bool success = false;
   if (strcmp(file_name, ".") != 0 && strcmp(file_name, "..") != 0){
     success = (dir != NULL
-                && free_map_allocate (1, &inode_sector)
+                && free_map_allocate_goal ( //@4-2 C: near the parent dir
+                     inode_get_inumber (dir_get_inode (dir)), 1, &inode_sector)
     && inode_create(inode_sector, initial_size, is_dir, dir_parent_inumber(dir))
                 && dir_add (dir, file_name, inode_sector)); //#A check name inside
   } //@4-4 C: IC.d.ver
   
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
+  free_map_flush (); //@4-2 in: filesys_create
+  journal_end ();
   dir_close (dir);
   //@4-4 in: filesys_create.2
   free(file_name);
@@ -134,8 +183,10 @@ filesys_remove (const char *name)
   char *file_name = path_to_name(name); //#A file_name need free
   //struct dir *dir = dir_open_root ();
 
+  journal_begin (JOURNAL_OP_MAX); //@4-2 in: filesys_remove
   bool success = dir != NULL && dir_remove (dir, file_name);
   dir_close (dir); 
+  journal_end ();
   //@4-4 in: filesys_remove.2
   free(file_name);
 
@@ -148,6 +199,7 @@ do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create (); //#A create free_map_file, free_map init in filesys_init
+  journal_create (); //@4-2 in: do_format
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close (); //#A free_map_file = NULL
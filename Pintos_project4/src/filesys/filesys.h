@@ -20,6 +20,11 @@ void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size, bool is_dir);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+//@4-1 F: filesys_sync
+void filesys_sync (void);
+//@4-1 F: filesys_get_stats
+struct fsstats;
+void filesys_get_stats (struct fsstats *);
 
 //@4-4 F: dir_parent_inode
 struct inode *dir_parent_inode(struct dir* dir);
@@ -1,12 +1,98 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+//@4-2 #include
+#include "threads/synch.h"
+#include "threads/malloc.h"
+#include "filesys/journal.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+//@4-2 Global-Val, dirty tracking
+#define FREE_MAP_BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+static struct bitmap *free_map_dirty; /* One bit per free map file sector. */
+static struct lock free_map_lock;     /* Guards both bitmaps. */
+static struct lock free_map_flush_lock; /* One free_map_flush at a time. */
+//@4-2 Global-Val, allocation groups
+#define FREE_MAP_GROUP_SIZE 1024      /* Sectors per allocation group. */
+static size_t group_cnt;
+static uint16_t *group_free;          /* Free sectors in each group. */
+
+//@4-2 F: mark_dirty, hold free_map_lock
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / FREE_MAP_BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / FREE_MAP_BITS_PER_SECTOR;
+  bitmap_set_multiple (free_map_dirty, first, last - first + 1, true);
+}
+
+//@4-2 F: group_count_all, recount every group from the bitmap
+static void
+group_count_all (void)
+{
+  size_t size = bitmap_size (free_map);
+  for (size_t g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * FREE_MAP_GROUP_SIZE;
+      size_t cnt = size - start < FREE_MAP_GROUP_SIZE
+                   ? size - start : FREE_MAP_GROUP_SIZE;
+      group_free[g] = bitmap_count (free_map, start, cnt, false);
+    }
+}
+
+//@4-2 F: group_adjust, CNT sectors from SECTOR became USED or free
+static void
+group_adjust (block_sector_t sector, size_t cnt, bool used)
+{
+  while (cnt > 0)
+    {
+      size_t g = sector / FREE_MAP_GROUP_SIZE;
+      size_t n = (g + 1) * FREE_MAP_GROUP_SIZE - sector;
+      if (n > cnt)
+        n = cnt;
+      if (used)
+        group_free[g] -= n;
+      else
+        group_free[g] += n;
+      sector += n;
+      cnt -= n;
+    }
+}
+
+//@4-2 F: group_scan, hold free_map_lock
+/* Finds CNT free consecutive sectors, trying GOAL first, then the
+   rest of GOAL's group, then the following groups in order,
+   wrapping around.  Groups whose free count is too small are
+   skipped without looking at their bits.
+   Returns the first sector, or BITMAP_ERROR if there is none. */
+static block_sector_t
+group_scan (block_sector_t goal, size_t cnt)
+{
+  size_t size = bitmap_size (free_map);
+  if (goal >= size)
+    goal = 0;
+  size_t g0 = goal / FREE_MAP_GROUP_SIZE;
+  for (size_t k = 0; k <= group_cnt; k++) //#A k == group_cnt: head of g0
+    {
+      size_t g = (g0 + k) % group_cnt;
+      if (cnt <= FREE_MAP_GROUP_SIZE && group_free[g] < cnt)
+        continue;
+      size_t start = k == 0 ? goal : g * FREE_MAP_GROUP_SIZE;
+      size_t end = (g + 1) * FREE_MAP_GROUP_SIZE;
+      if (end > size)
+        end = size;
+      for (size_t i = start; i < end && i + cnt <= size; i++)
+        if (!bitmap_contains (free_map, i, cnt, true))
+          return i;
+    }
+  //#A a run across a group boundary, or longer than a group
+  return bitmap_scan (free_map, 0, cnt, false);
+}
 
 /* Initializes the free map. */
 void
@@ -17,37 +103,143 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR); //#A set 0 & 1 sector as used
+  //@4-2 in: free_map_init, journal header and log
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, 1 + journal_size (), true);
+  //@4-2 in: free_map_init
+  free_map_dirty = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                                BLOCK_SECTOR_SIZE));
+  if (free_map_dirty == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
+  lock_init (&free_map_flush_lock);
+  //@4-2 in: free_map_init, allocation groups
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), FREE_MAP_GROUP_SIZE);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC ("free map group creation failed");
+  group_count_all ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.
+   //@4-2 C: the change reaches the free map file at free_map_flush() */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR  //#A check for bitmap_write
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file)) 
-    {   //#A come in if bitmap_write fail.
-      bitmap_set_multiple (free_map, sector, cnt, false);//@4-x no-consecutive
-      sector = BITMAP_ERROR;
-    }
+  return free_map_allocate_goal (0, cnt, sectorp);
+}
+
+//@4-2 F: free_map_allocate_goal
+/* Like free_map_allocate(), but places the sectors at GOAL or as
+   close after it as possible.  GOAL is normally the sector after
+   the file's previous block, or its parent directory's inode. */
+bool
+free_map_allocate_goal (block_sector_t goal, size_t cnt,
+                        block_sector_t *sectorp)
+{
+  lock_acquire (&free_map_lock);
+  block_sector_t sector = group_scan (goal, cnt);
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      group_adjust (sector, cnt, true);
+      mark_dirty (sector, cnt);
+      *sectorp = sector;
+    }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+//@4-2 F: free_map_allocate_run
+/* Allocates one run of up to MAX consecutive free sectors, looking
+   first at HINT and then onward from it by group, and stores
+   the first into *SECTORP.  A free sector at HINT is always used,
+   so a file can keep growing its last run.
+   Returns the run length, 0 if the disk is full. */
+size_t
+free_map_allocate_run (block_sector_t hint, size_t max,
+                       block_sector_t *sectorp)
+{
+  size_t size = bitmap_size (free_map);
+  lock_acquire (&free_map_lock);
+  block_sector_t start = group_scan (hint, 1);
+  if (start == BITMAP_ERROR || max == 0)
+    {
+      lock_release (&free_map_lock);
+      return 0;
+    }
+
+  size_t cnt = 1;
+  while (cnt < max && start + cnt < size
+         && !bitmap_test (free_map, start + cnt))
+    cnt++;
+  bitmap_set_multiple (free_map, start, cnt, true);
+  group_adjust (start, cnt, true);
+  mark_dirty (start, cnt);
+  lock_release (&free_map_lock);
+  *sectorp = start;
+  return cnt;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);//#A bitmap_set 1by1 inside
-  bitmap_write (free_map, free_map_file); 
-}   //#A write bitmap to file, not disk for now ?
+  group_adjust (sector, cnt, false);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}   //@4-2 C: written to file at free_map_flush()
+
+//@4-2 F: free_map_flush
+/* Writes the free map file sectors changed since the last flush,
+   through the buffer cache.  Called once at the end of an
+   operation that allocates or releases sectors, rather than once
+   per sector.
+   Each sector is copied out under free_map_lock but written
+   without it, since the write goes through the inode layer;
+   free_map_flush_lock keeps an older copy from landing last. */
+void
+free_map_flush (void)
+{
+  uint8_t buf[BLOCK_SECTOR_SIZE];
+  size_t file_size = bitmap_file_size (free_map);
+  size_t i = 0;
+
+  lock_acquire (&free_map_flush_lock);
+  while (free_map_file != NULL)
+    {
+      size_t ofs = 0, size = 0;
+      lock_acquire (&free_map_lock);
+      i = bitmap_scan_and_flip (free_map_dirty, i, 1, true);
+      if (i != BITMAP_ERROR)
+        {
+          ofs = i * BLOCK_SECTOR_SIZE;
+          size = file_size - ofs < BLOCK_SECTOR_SIZE
+                 ? file_size - ofs : BLOCK_SECTOR_SIZE;
+          bitmap_copy_partial (free_map, buf, ofs, size);
+        }
+      lock_release (&free_map_lock);
+      if (i == BITMAP_ERROR)
+        break;
+      if ((size_t) file_write_at (free_map_file, buf, size, ofs) != size)
+        PANIC ("can't write free map");
+    }
+  lock_release (&free_map_flush_lock);
+}
+
+//@4-2 F: free_map_sectors
+/* Returns the number of sectors in the free map file, the most
+   free_map_flush can write in one go. */
+size_t
+free_map_sectors (void)
+{
+  return bitmap_size (free_map_dirty);
+}
 
 /* Opens the free map file and reads it from disk. */
 void
@@ -58,13 +250,18 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  //@4-2 in: free_map_open
+  group_count_all ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  //@4-2 in: free_map_close
+  free_map_flush ();
   file_close (free_map_file); //#A inode in open_inodes
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -83,4 +280,6 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  //@4-2 in: free_map_create, all of it just written
+  bitmap_set_all (free_map_dirty, false);
 }
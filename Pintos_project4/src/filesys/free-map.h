@@ -12,6 +12,16 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+//@4-2 F: free_map_allocate_goal
+bool free_map_allocate_goal (block_sector_t goal, size_t,
+                             block_sector_t *);
+//@4-2 F: free_map_allocate_run
+size_t free_map_allocate_run (block_sector_t hint, size_t max,
+                              block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+//@4-2 F: free_map_flush
+void free_map_flush (void);
+//@4-2 F: free_map_sectors, sectors of the free map file
+size_t free_map_sectors (void);
 
 #endif /* filesys/free-map.h */
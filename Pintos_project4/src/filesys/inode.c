@@ -1,5 +1,7 @@
 #include "filesys/inode.h"
 #include <list.h>
+//@4-3 #include
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
@@ -9,9 +11,30 @@
 //@4-1 #include
 #include "filesys/cache.h"
 //@4-2 #include
+#include "filesys/journal.h"
+//@4-2 #include
 #include <stdbool.h>
-//@4-2 Global-Val
-static uint8_t zeros_for_init[BLOCK_SECTOR_SIZE];
+//@4-1 #include
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/pagedir.h"
+#endif
+//@4-2 Global-Val, extent layout
+#define INODE_LAYOUT_BLOCKS 0   //#A L1_sec / L2_sec / L3_sec
+#define INODE_LAYOUT_EXTENT 1   //#A (start, length) runs in ext[]
+#define INODE_LAYOUT_INLINE 2   //#A file bytes themselves in inline_data[]
+#define INODE_EXT_MAX 51
+#define INODE_INLINE_MAX (INODE_EXT_MAX * 8) //#A bytes, shares ext[]'s space
+//@4-2 Global-Val, journal
+#define INODE_WRITE_CHUNK (64 * BLOCK_SECTOR_SIZE) //#A bytes per operation
+bool inode_use_extents;         //#A -extents: new inodes use extents
+
+//@4-2 S: inode_extent, LENGTH sectors from START
+struct inode_extent{
+    block_sector_t start;
+    uint32_t length;
+  };
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -30,7 +53,14 @@ struct inode_disk
     //@4-4 in: inode_disk
     uint32_t is_directory; //#A as bool, is:1; isnt:0
     block_sector_t dir_in; //#A if is_dir, dir_in = parent-dir (root-par = root)
-    uint32_t unused[105];               /* Not used. */
+    //@4-2 in: inode_disk, extent layout
+    uint32_t layout;                    //#A INODE_LAYOUT_*
+    uint32_t ext_cnt;
+    union{
+      struct inode_extent ext[INODE_EXT_MAX]; //#A used iff INODE_LAYOUT_EXTENT
+      uint8_t inline_data[INODE_INLINE_MAX];  //#A used iff INODE_LAYOUT_INLINE
+    };
+    uint32_t unused[1];                 /* Not used. */
   };//#A 512 Bytes
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
@@ -49,11 +79,43 @@ struct inode_mem{
     block_sector_t L3_sec;
     uint32_t is_directory; 
     block_sector_t dir_in; 
+    uint32_t layout;
+    uint32_t ext_cnt;
+    union{
+      struct inode_extent ext[INODE_EXT_MAX];
+      uint8_t inline_data[INODE_INLINE_MAX];
+    };
+    block_sector_t goal;           //#A MEM only: where the next block should go
+    block_sector_t sector;         //#A MEM only: owner of its blocks
   };
+
+//@4-2 F: goal_alloc, one sector as near INODE_MEM's goal as possible
+static bool
+goal_alloc (struct inode_mem *inode_mem, block_sector_t *sectorp)
+{
+  if(!free_map_allocate_goal(inode_mem->goal, 1, sectorp))
+    return false;
+  inode_mem->goal = *sectorp + 1;
+  return true;
+}
+
+//@4-2 F: goal_after, right after the last non-hole pointer in TABLE[0..N)
+//#A all holes: the goal stays where it was, by the inode
+static void
+goal_after (struct inode_mem *inode_mem, const block_sector_t *table,
+            size_t n)
+{
+  while (n-- > 0)
+    if (table[n] != 0)
+      {
+        inode_mem->goal = table[n] + 1;
+        return;
+      }
+}
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
@@ -65,14 +127,54 @@ struct inode
     struct inode_mem data;
     //@4-3 in: inode
     struct lock inode_lock;
+    bool loading;                       //#A inode_open reading it, lock held
+    //@4-1 in: inode, logical -> physical, direct-mapped
+    struct lock map_lock;
+    block_sector_t map_lsec[INODE_MAP_SIZE]; //#A -1 if slot empty
+    block_sector_t map_psec[INODE_MAP_SIZE];
   };
 
+//@4-1 F: inode_map_find, -1 if not cached
+static block_sector_t
+inode_map_find (struct inode *inode, block_sector_t lsec)
+{
+  block_sector_t psec = -1;
+  lock_acquire (&inode->map_lock);
+  if (inode->map_lsec[lsec % INODE_MAP_SIZE] == lsec)
+    psec = inode->map_psec[lsec % INODE_MAP_SIZE];
+  lock_release (&inode->map_lock);
+  return psec;
+}
+
+//@4-1 F: inode_map_add
+static void
+inode_map_add (struct inode *inode, block_sector_t lsec, block_sector_t psec)
+{
+  lock_acquire (&inode->map_lock);
+  inode->map_lsec[lsec % INODE_MAP_SIZE] = lsec;
+  inode->map_psec[lsec % INODE_MAP_SIZE] = psec;
+  lock_release (&inode->map_lock);
+}
+
+//@4-2 F: ext_to_sector, logical sector LSEC -> disk, -1 if past the end
+static block_sector_t
+ext_to_sector (const struct inode_mem *inode_mem, block_sector_t lsec)
+{
+  for (uint32_t i = 0; i < inode_mem->ext_cnt; i++)
+    {
+      if (lsec < inode_mem->ext[i].length)
+        return inode_mem->ext[i].start + lsec;
+      lsec -= inode_mem->ext[i].length;
+    }
+  return -1;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos, bool is_write) 
+byte_to_sector (struct inode *inode, off_t pos, bool is_write) 
 { //@4-1* C: B2S.w.ver
   ASSERT (inode != NULL);
   //@4-2 in: byte_to_sector
@@ -84,23 +186,42 @@ byte_to_sector (const struct inode *inode, off_t pos, bool is_write)
       return -1;
 
   block_sector_t offest_in_sec = pos / BLOCK_SECTOR_SIZE;
+  //@4-2 in: byte_to_sector, extent layout
+  if(inode->data.layout == INODE_LAYOUT_EXTENT)
+    return ext_to_sector(&inode->data, offest_in_sec);
   if(offest_in_sec < INODE_L1_SIZE){
     return inode->data.L1_sec[offest_in_sec];
   }
-  else if(offest_in_sec < INODE_L2_SIZE){
-    block_sector_t indirect[BLOCK_SECTOR_SIZE / 4];
-    block_read(fs_device, inode->data.L2_sec, &indirect);
-    return indirect[offest_in_sec - INODE_L1_SIZE];
+  //@4-1 in: byte_to_sector, map cache first
+  block_sector_t sector = inode_map_find(inode, offest_in_sec);
+  if(sector != (block_sector_t) -1)
+    return sector;
+
+  //#A only the one pointer we need, through buffer cache
+  //@4-2 C: a 0 pointer anywhere on the way is a hole, returns 0
+  if(offest_in_sec < INODE_L2_SIZE){
+    if(inode->data.L2_sec == 0)
+      return 0;
+    cache_read_at(inode->data.L2_sec, &sector,
+                  (offest_in_sec - INODE_L1_SIZE) * 4, 4);
   }
   else if(offest_in_sec < FILE_MAX_SECTORS){
     block_sector_t ent_num = BLOCK_SECTOR_SIZE / 4;
-    block_sector_t temp[BLOCK_SECTOR_SIZE / 4];
-    block_read(fs_device, inode->data.L3_sec, &temp);
-    block_read(fs_device, temp[(offest_in_sec - INODE_L2_SIZE) / ent_num], 
-                &temp);
-    return temp[(offest_in_sec - INODE_L2_SIZE) % ent_num];
+    block_sector_t indirect;
+    if(inode->data.L3_sec == 0)
+      return 0;
+    cache_read_at(inode->data.L3_sec, &indirect,
+                  (offest_in_sec - INODE_L2_SIZE) / ent_num * 4, 4);
+    if(indirect == 0)
+      return 0;
+    cache_read_at(indirect, &sector,
+                  (offest_in_sec - INODE_L2_SIZE) % ent_num * 4, 4);
   }
-  return -1;
+  else
+    return -1;
+  if(sector != 0) //#A holes never go in the map, they get filled
+    inode_map_add(inode, offest_in_sec, sector);
+  return sector;
 
   // if (pos < inode->data.length)
   //   return inode->data.start + pos / BLOCK_SECTOR_SIZE;
@@ -108,16 +229,33 @@ byte_to_sector (const struct inode *inode, off_t pos, bool is_write)
   //   return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
+/* Open inodes by sector, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes; //#A global inode-list
+static struct hash open_inodes; //@4-3 C: was a list, O(1) by sector now
+static struct lock open_inodes_lock; //#A open_inodes & every open_cnt
+
+//@4-3 F: open_inode_hash
+static unsigned
+open_inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+//@4-3 F: open_inode_less
+static bool
+open_inode_less (const struct hash_elem *a, const struct hash_elem *b,
+                 void *aux UNUSED)
+{
+  return hash_entry (a, struct inode, elem)->sector
+         < hash_entry (b, struct inode, elem)->sector;
+}
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
-  //@4-2 in: inode_init
-  memset(zeros_for_init, 0, BLOCK_SECTOR_SIZE);
+  hash_init (&open_inodes, open_inode_hash, open_inode_less, NULL);
+  lock_init (&open_inodes_lock);
 }
 
 //@4-2 F: lv1_allocate
@@ -131,10 +269,10 @@ uint32_t lv1_allocate(size_t sectors, struct inode_mem *inode_mem){
   uint32_t data_sec_alloc = 0;
   int i;
   for(i = inode_mem->sec_num; i < sectors && i < INODE_L1_SIZE; i++){
-    success = free_map_allocate(1, &inode_mem->L1_sec[i]);
+    success = goal_alloc(inode_mem, &inode_mem->L1_sec[i]);
     if(success == false)
       break;
-    block_write(fs_device, inode_mem->L1_sec[i], zeros_for_init);
+    cache_zero(inode_mem->L1_sec[i], false, inode_mem->sector);
     data_sec_alloc ++;
   }
   //#A tail
@@ -155,27 +293,29 @@ uint32_t lv2_allocate(size_t sectors, struct inode_mem *inode_mem){
   bool success = true;
   //#A cond: grow
   if(inode_mem->sec_num == INODE_L1_SIZE){
-    success = free_map_allocate(1, &inode_mem->L2_sec);
+    success = goal_alloc(inode_mem, &inode_mem->L2_sec);
     if(success == false)
       return 0;
     memset(indirect, 0, BLOCK_SECTOR_SIZE);
   }
   else{ //#A already L2_sec
-    block_read(fs_device, inode_mem->L2_sec, indirect);
+    cache_read_at(inode_mem->L2_sec, indirect, 0, BLOCK_SECTOR_SIZE);
+    goal_after(inode_mem, indirect, inode_mem->sec_num - INODE_L1_SIZE);
   }
   //#A loop aloc sectors
   uint32_t data_sec_alloc = 0;
   int i;
   for(i = inode_mem->sec_num; i < sectors && i < INODE_L2_SIZE; i++){
-    success = free_map_allocate(1, &indirect[(i - INODE_L1_SIZE) % ent_num]);
+    success = goal_alloc(inode_mem, &indirect[(i - INODE_L1_SIZE) % ent_num]);
     if(success == false)
       break;
-    block_write(fs_device, indirect[(i - INODE_L1_SIZE) % ent_num], 
-                zeros_for_init);
+    cache_zero(indirect[(i - INODE_L1_SIZE) % ent_num], false,
+               inode_mem->sector);
     data_sec_alloc ++;
   }
   //#A tail
-  block_write(fs_device, inode_mem->L2_sec, indirect);
+  cache_write_meta(inode_mem->L2_sec, indirect, 0, BLOCK_SECTOR_SIZE,
+                   inode_mem->sector);
   inode_mem->sec_num = i;
   return data_sec_alloc;
 }
@@ -193,21 +333,24 @@ uint32_t lv3_allocate(size_t sectors, struct inode_mem *inode_mem){
   bool success = true;
   //#A cond: grow
   if(inode_mem->sec_num == INODE_L2_SIZE){
-    success = free_map_allocate(1, &inode_mem->L3_sec);
+    success = goal_alloc(inode_mem, &inode_mem->L3_sec);
     if(success = false)
       return 0;
     memset(in_indirect, 0, BLOCK_SECTOR_SIZE);
   }
   else{ //#A already L3_sec
-    block_read(fs_device, inode_mem->L3_sec, in_indirect);
+    cache_read_at(inode_mem->L3_sec, in_indirect, 0, BLOCK_SECTOR_SIZE);
   }
 
   if((inode_mem->sec_num - INODE_L2_SIZE) % ent_num == 0){
     memset(indirect, 0, BLOCK_SECTOR_SIZE);
   }
   else{ //#A start from last used-indirect-sector
-    block_read(fs_device, 
-      in_indirect[(inode_mem->sec_num - INODE_L2_SIZE) / ent_num], indirect);
+    cache_read_at(
+      in_indirect[(inode_mem->sec_num - INODE_L2_SIZE) / ent_num], indirect,
+      0, BLOCK_SECTOR_SIZE);
+    goal_after(inode_mem, indirect,
+               (inode_mem->sec_num - INODE_L2_SIZE) % ent_num);
   }
   //#A loop aloc sectors
   uint32_t data_sec_alloc = 0;
@@ -215,34 +358,102 @@ uint32_t lv3_allocate(size_t sectors, struct inode_mem *inode_mem){
   for(i = inode_mem->sec_num; i < sectors && i < FILE_MAX_SECTORS; i++){
     if((i - INODE_L2_SIZE) % ent_num == 0){ //#A change an indirect-sector
       success = 
-        free_map_allocate(1, &in_indirect[(i - INODE_L2_SIZE) / ent_num]);
+        goal_alloc(inode_mem, &in_indirect[(i - INODE_L2_SIZE) / ent_num]);
       if(success == false)
         break;
       if(i != inode_mem->sec_num){
-        block_write(fs_device, 
-          in_indirect[((i - INODE_L2_SIZE) / ent_num) - 1], indirect);
+        cache_write_meta(
+          in_indirect[((i - INODE_L2_SIZE) / ent_num) - 1], indirect,
+          0, BLOCK_SECTOR_SIZE, inode_mem->sector);
         memset(indirect, 0, BLOCK_SECTOR_SIZE);
       }  
     }
-    success = free_map_allocate(1, &indirect[(i - INODE_L2_SIZE) % ent_num]);
+    success = goal_alloc(inode_mem, &indirect[(i - INODE_L2_SIZE) % ent_num]);
     if(success == false)
       break;
-    block_write(fs_device, indirect[(i - INODE_L2_SIZE) % ent_num], 
-                zeros_for_init);
+    cache_zero(indirect[(i - INODE_L2_SIZE) % ent_num], false,
+               inode_mem->sector);
     data_sec_alloc ++;
   }
   //#A tail
-  block_write(fs_device, //#A NOT (sectors - 1) / ent_num
-             in_indirect[(i - 1 - INODE_L2_SIZE) / ent_num], indirect); 
-  block_write(fs_device, inode_mem->L3_sec, in_indirect);
+  cache_write_meta( //#A NOT (sectors - 1) / ent_num
+             in_indirect[(i - 1 - INODE_L2_SIZE) / ent_num], indirect,
+             0, BLOCK_SECTOR_SIZE, inode_mem->sector); 
+  cache_write_meta(inode_mem->L3_sec, in_indirect, 0, BLOCK_SECTOR_SIZE,
+                   inode_mem->sector);
   inode_mem->sec_num = i;
   return data_sec_alloc;
 }
+//@4-2 F: ext_allocate, grow by whole runs, merged when contiguous
+//@4-2 C: a new sector that bytes OFFSET...OFFSET+SIZE, about to be
+//#A written, cover whole isn't zeroed; it's past the length, so no
+//#A reader gets to it first
+static uint32_t ext_allocate(size_t sectors, struct inode_mem *inode_mem,
+                             off_t offset, off_t size){
+  ASSERT(sectors >= inode_mem->sec_num);
+  uint32_t data_sec_alloc = 0;
+  while(inode_mem->sec_num < sectors){
+    struct inode_extent *last = inode_mem->ext_cnt > 0 
+                                ? &inode_mem->ext[inode_mem->ext_cnt - 1]
+                                : NULL;
+    block_sector_t hint = last != NULL ? last->start + last->length
+                                       : inode_mem->goal;
+    block_sector_t start;
+    size_t cnt = free_map_allocate_run(hint, sectors - inode_mem->sec_num,
+                                       &start);
+    if(cnt == 0)
+      break;
+    if(last != NULL && start == hint) //#A right after the last run
+      last->length += cnt;
+    else if(inode_mem->ext_cnt < INODE_EXT_MAX){
+      inode_mem->ext[inode_mem->ext_cnt].start = start;
+      inode_mem->ext[inode_mem->ext_cnt].length = cnt;
+      inode_mem->ext_cnt++;
+    }
+    else{ //#A too fragmented for ext[]
+      free_map_release(start, cnt);
+      break;
+    }
+    for(size_t i = 0; i < cnt; i++){
+      off_t pos = (off_t) (inode_mem->sec_num + i) * BLOCK_SECTOR_SIZE;
+      if(pos < offset || pos + BLOCK_SECTOR_SIZE > offset + size)
+        cache_zero(start + i, false, inode_mem->sector);
+    }
+    inode_mem->sec_num += cnt;
+    data_sec_alloc += cnt;
+  }
+  return data_sec_alloc;
+}
+//@4-2 F: ext_free
+static uint32_t ext_free(struct inode_mem *inode_mem){
+  uint32_t data_sec_del = 0;
+  for(uint32_t i = 0; i < inode_mem->ext_cnt; i++){
+    free_map_release(inode_mem->ext[i].start, inode_mem->ext[i].length);
+    data_sec_del += inode_mem->ext[i].length;
+  }
+  return data_sec_del;
+}
 //@4-2 T: inode_sector_allocate
-bool inode_sector_allocate(size_t sectors, struct inode_mem *inode_mem){
+//#A bytes OFFSET...OFFSET+SIZE will be written at once, no need to zero
+bool inode_sector_allocate(size_t sectors, struct inode_mem *inode_mem,
+                           off_t offset, off_t size){
   ASSERT(inode_mem->sec_num <= FILE_MAX_SECTORS);
   ASSERT(sectors <= FILE_MAX_SECTORS);
+  //@4-2 in: inode_sector_allocate, extent layout
+  if(inode_mem->layout == INODE_LAYOUT_EXTENT){
+    ext_allocate(sectors, inode_mem, offset, size);
+    return inode_mem->sec_num >= sectors; //#A more: left by a short write
+  }
   
+  //@4-2 in: inode_sector_allocate, sparse: only sec_num grows,
+  //#A the new sectors are holes until sparse_fill
+  if(inode_mem->sec_num < sectors)
+    inode_mem->sec_num = sectors;
+  return true;
+}
+//@4-2 F: inode_sector_reserve, allocate every sector now, no holes
+//#A for the free map file, which can't allocate while being written
+static bool inode_sector_reserve(size_t sectors, struct inode_mem *inode_mem){
   uint32_t data_sec_alloc = 0;
   uint32_t true_alloc = sectors - inode_mem->sec_num;
 
@@ -259,7 +470,7 @@ void inode_data_read_up(block_sector_t sector, struct inode_mem *inode_mem){
   struct inode_disk disk_inode;
   ASSERT(sizeof disk_inode == BLOCK_SECTOR_SIZE);
 
-  block_read(fs_device, sector, &disk_inode);
+  cache_read_at(sector, &disk_inode, 0, BLOCK_SECTOR_SIZE);
   inode_mem->length = disk_inode.length;
   inode_mem->sec_num = disk_inode.sec_num;
   for(int i = 0; i < INODE_L1_SIZE; i++)
@@ -268,6 +479,10 @@ void inode_data_read_up(block_sector_t sector, struct inode_mem *inode_mem){
   inode_mem->L3_sec = disk_inode.L3_sec;
   inode_mem->is_directory = disk_inode.is_directory;
   inode_mem->dir_in = disk_inode.dir_in;
+  //@4-2 in: inode_data_read_up, extent layout
+  inode_mem->layout = disk_inode.layout;
+  inode_mem->ext_cnt = disk_inode.ext_cnt;
+  memcpy(inode_mem->ext, disk_inode.ext, sizeof inode_mem->ext);
   return;
 }
 //@4-2 F: inode_data_write_down
@@ -284,7 +499,11 @@ void inode_data_write_down(block_sector_t sector,struct inode_mem *inode_mem){
   disk_inode.L3_sec = inode_mem->L3_sec;
   disk_inode.is_directory = inode_mem->is_directory;
   disk_inode.dir_in = inode_mem->dir_in;
-  block_write(fs_device, sector, &disk_inode);
+  //@4-2 in: inode_data_write_down, extent layout
+  disk_inode.layout = inode_mem->layout;
+  disk_inode.ext_cnt = inode_mem->ext_cnt;
+  memcpy(disk_inode.ext, inode_mem->ext, sizeof disk_inode.ext);
+  cache_write_meta(sector, &disk_inode, 0, BLOCK_SECTOR_SIZE, sector);
   return;
 }
 
@@ -313,11 +532,34 @@ inode_create (block_sector_t sector, off_t length,
   //@4-4 in: inode_create
   inode_mem->is_directory = is_dir;
   inode_mem->dir_in = dir_in;
+  //@4-2 in: inode_create, extent layout
+  inode_mem->layout = inode_use_extents ? INODE_LAYOUT_EXTENT
+                                        : INODE_LAYOUT_BLOCKS;
+  inode_mem->ext_cnt = 0;
+  //@4-2 in: inode_create, a small file lives in the inode sector itself
+  if(!is_dir && sector != FREE_MAP_SECTOR && length <= INODE_INLINE_MAX)
+    inode_mem->layout = INODE_LAYOUT_INLINE;
+  //@4-2 in: inode_create, data right after the inode
+  inode_mem->goal = sector + 1;
+  inode_mem->sector = sector;
 
   inode_mem->sec_num = 0;
-  ASSERT(inode_sector_allocate(sectors, inode_mem));
-  ASSERT(inode_mem->sec_num == bytes_to_sectors(length));
+  bool success = true;
+  //@4-2 in: inode_create, free map is never sparse
+  if(sector == FREE_MAP_SECTOR && inode_mem->layout == INODE_LAYOUT_BLOCKS)
+    success = inode_sector_reserve(sectors, inode_mem);
+  else if(inode_mem->layout != INODE_LAYOUT_INLINE)
+    success = inode_sector_allocate(sectors, inode_mem, 0, 0);
+  if(success == false){ //#A disk full, or too fragmented for ext[]
+    if(inode_mem->layout == INODE_LAYOUT_EXTENT)
+      ext_free(inode_mem);
+    free(inode_mem);
+    return false;
+  }
+  ASSERT(inode_mem->sec_num == bytes_to_sectors(length)
+         || inode_mem->layout == INODE_LAYOUT_INLINE);
   inode_data_write_down(sector, inode_mem);
+  free_map_flush(); //@4-2 in: inode_create, one free map write per create
 
   free(inode_mem);
   
@@ -330,38 +572,67 @@ inode_create (block_sector_t sector, off_t length,
 struct inode *
 inode_open (block_sector_t sector) //#A sector in disk
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct hash_elem *e;
+  struct inode *inode, key;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  //@4-3 C: a new inode goes in first, marked loading, and is read
+  //#A without open_inodes_lock; its inode_lock is held until then
+  lock_acquire (&open_inodes_lock);
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++; //#A inode_reopen, lock already held
+      lock_release (&open_inodes_lock);
+      if (inode->loading) //#A wait for whoever is reading it in
         {
-          inode_reopen (inode); //#A just open_cnt ++
-          return inode; 
+          lock_acquire (&inode->inode_lock);
+          lock_release (&inode->inode_lock);
         }
+      return inode; 
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem); //#A remove in inode_close
   inode->sector = sector;
+  //@4-3 in: inode_open
+  lock_init(&inode->inode_lock);
+  lock_acquire(&inode->inode_lock);
+  inode->loading = true;
+  hash_insert (&open_inodes, &inode->elem); //#A remove in inode_close
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false; //#A delay remove, check in inode_close
+  lock_release (&open_inodes_lock);
+
   inode_data_read_up(sector, &inode->data);
   //block_read (fs_device, inode->sector, &inode->data); //#A a copy in MEM
   //@4-1* in: inode_open
   inode->write_length = inode->data.length;
-  //@4-3 in: inode_open
-  lock_init(&inode->inode_lock);
+  //@4-2 in: inode_open, next block goes after the last one we can see
+  inode->data.goal = sector + 1;
+  inode->data.sector = sector;
+  if(inode->data.layout == INODE_LAYOUT_EXTENT && inode->data.ext_cnt > 0)
+    inode->data.goal = inode->data.ext[inode->data.ext_cnt - 1].start
+                       + inode->data.ext[inode->data.ext_cnt - 1].length;
+  else if(inode->data.layout == INODE_LAYOUT_BLOCKS
+          && inode->data.sec_num <= INODE_L1_SIZE)
+    goal_after(&inode->data, inode->data.L1_sec, inode->data.sec_num);
+  //@4-1 in: inode_open
+  lock_init(&inode->map_lock);
+  for(int i = 0; i < INODE_MAP_SIZE; i++)
+    inode->map_lsec[i] = -1;
+  inode->loading = false;
+  lock_release(&inode->inode_lock);
 
   return inode;
 }
@@ -371,7 +642,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -390,7 +665,8 @@ uint32_t lv1_free(struct inode_mem *inode_mem){
   
   uint32_t data_sec_del = 0;
   for(int i = 0; i < sectors && i < INODE_L1_SIZE; i++){
-    free_map_release(inode_mem->L1_sec[i], 1);
+    if(inode_mem->L1_sec[i] != 0) //@4-2 C: skip holes
+      free_map_release(inode_mem->L1_sec[i], 1);
     data_sec_del ++;
   }
   return data_sec_del;
@@ -401,14 +677,20 @@ uint32_t lv2_free(struct inode_mem *inode_mem){
   if(sectors <= INODE_L1_SIZE)
     return 0;
   block_sector_t indirect[BLOCK_SECTOR_SIZE / 4];
-  block_read(fs_device, inode_mem->L2_sec, indirect);
+  //@4-2 C: skip holes, L2_sec itself may be one
+  if(inode_mem->L2_sec != 0)
+    cache_read_at(inode_mem->L2_sec, indirect, 0, BLOCK_SECTOR_SIZE);
+  else
+    memset(indirect, 0, BLOCK_SECTOR_SIZE);
 
   uint32_t data_sec_del = 0;
   for(int i = INODE_L1_SIZE; i < sectors && i < INODE_L2_SIZE; i++){
-    free_map_release(indirect[i - INODE_L1_SIZE], 1);
+    if(indirect[i - INODE_L1_SIZE] != 0)
+      free_map_release(indirect[i - INODE_L1_SIZE], 1);
     data_sec_del ++;
   }
-  free_map_release(inode_mem->L2_sec, 1);
+  if(inode_mem->L2_sec != 0)
+    free_map_release(inode_mem->L2_sec, 1);
   return data_sec_del;
 }
 //@4-2 F: lv3_free
@@ -418,7 +700,11 @@ uint32_t lv3_free(struct inode_mem *inode_mem){
     return 0;
   
   block_sector_t in_indirect[BLOCK_SECTOR_SIZE / 4];
-  block_read(fs_device, inode_mem->L3_sec, in_indirect);
+  //@4-2 C: skip holes, at every level
+  if(inode_mem->L3_sec != 0)
+    cache_read_at(inode_mem->L3_sec, in_indirect, 0, BLOCK_SECTOR_SIZE);
+  else
+    memset(in_indirect, 0, BLOCK_SECTOR_SIZE);
 
   block_sector_t indirect[BLOCK_SECTOR_SIZE / 4];
 
@@ -427,21 +713,37 @@ uint32_t lv3_free(struct inode_mem *inode_mem){
   uint32_t data_sec_del = 0;
   for(int i = INODE_L2_SIZE; i < sectors && i < FILE_MAX_SECTORS; i++){
     if((i - INODE_L2_SIZE) % ent_num == 0){ //#A change an indirect-sector
-      block_read(fs_device, in_indirect[(i - INODE_L2_SIZE) / ent_num], 
-                  indirect);
-      free_map_release(in_indirect[(i - INODE_L2_SIZE) / ent_num], 1);
+      block_sector_t ind = in_indirect[(i - INODE_L2_SIZE) / ent_num];
+      if(ind != 0){
+        cache_read_at(ind, indirect, 0, BLOCK_SECTOR_SIZE);
+        free_map_release(ind, 1);
+      }
+      else
+        memset(indirect, 0, BLOCK_SECTOR_SIZE);
     }
-    free_map_release(indirect[(i - INODE_L2_SIZE) % ent_num], 1);
+    if(indirect[(i - INODE_L2_SIZE) % ent_num] != 0)
+      free_map_release(indirect[(i - INODE_L2_SIZE) % ent_num], 1);
     data_sec_del ++;
   }
-  free_map_release(inode_mem->L3_sec, 1);
+  if(inode_mem->L3_sec != 0)
+    free_map_release(inode_mem->L3_sec, 1);
   return data_sec_del;
 }
 //@4-2 T: inode_sector_free
 bool inode_sector_free(struct inode *inode){
-  uint32_t true_del = bytes_to_sectors(inode->data.length);
-  ASSERT(true_del == inode->data.sec_num);
+  //@4-2 in: inode_sector_free, inline data goes with the inode sector
+  if(inode->data.layout == INODE_LAYOUT_INLINE)
+    return true;
+  //@4-2 C: a short write may leave sectors allocated past the length
+  uint32_t true_del = inode->data.sec_num;
+  ASSERT(bytes_to_sectors(inode->data.length) <= true_del);
   uint32_t data_sec_del = 0;
+  //@4-2 in: inode_sector_free, extent layout
+  if(inode->data.layout == INODE_LAYOUT_EXTENT){
+    data_sec_del = ext_free(&inode->data);
+    ASSERT(data_sec_del == true_del);
+    return true;
+  }
   data_sec_del += lv1_free(&inode->data);
   data_sec_del += lv2_free(&inode->data);
   data_sec_del += lv3_free(&inode->data);
@@ -459,16 +761,24 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  bool last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+  if (last)
     {
       /* Remove from inode list and release lock. */
-      list_remove (&inode->elem); //#A NO-LOCK in this func!
+      //@4-3 C: gone from open_inodes above, under open_inodes_lock
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         { 
+          journal_begin (JOURNAL_OP_MAX); //@4-2 in: inode_close
           free_map_release (inode->sector, 1); //#A inode ifself (bitmap)
           //@4-2 in: inode_close
           inode_sector_free(inode);
+          free_map_flush();
+          journal_end ();
           // free_map_release (inode->data.start, //#A data (bitmap)
           //                   bytes_to_sectors (inode->data.length));
         } //#A write in inode_close -> bitmap_write
@@ -485,15 +795,63 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+//@4-1 F: direct_buffer, kernel address of the sector-sized buffer at P
+//#A NULL if it straddles two user pages; then it goes through the cache
+static void *
+direct_buffer (const void *p)
+{
+  if (is_kernel_vaddr (p))
+    return (void *) p;
+#ifdef USERPROG
+  if (pg_ofs (p) + BLOCK_SECTOR_SIZE <= PGSIZE)
+    return pagedir_get_page (thread_current ()->pagedir, p);
+#endif
+  return NULL;
+}
+
+//@4-2 F: inline_read, -1 if INODE is not (or no longer) inline
+static off_t
+inline_read (struct inode *inode, void *buffer, off_t size, off_t offset)
+{
+  uint8_t data[INODE_INLINE_MAX];
+  off_t bytes_read = -1;
+
+  lock_acquire (&inode->inode_lock);
+  if (inode->data.layout == INODE_LAYOUT_INLINE)
+    {
+      off_t inode_left = inode->data.length - offset;
+      bytes_read = size < inode_left ? size : inode_left;
+      if (bytes_read < 0)
+        bytes_read = 0;
+      memcpy (data, inode->data.inline_data + offset, bytes_read);
+    }
+  lock_release (&inode->inode_lock);
+  //#A user BUFFER may fault, not while holding inode_lock
+  if (bytes_read > 0)
+    memcpy (buffer, data, bytes_read);
+  return bytes_read;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+   than SIZE if an error occurs or end of file is reached.
+   //@4-1 C: DIRECT: whole sectors skip the cache, see cache_read_direct */
+static off_t
+read_at (struct inode *inode, void *buffer_, off_t size, off_t offset,
+         bool direct)
 {   //#A like inode_write_at
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
+
+  //@4-2 in: read_at, inline data, no sector to read at all
+  if (inode->data.layout == INODE_LAYOUT_INLINE)
+    {
+      bytes_read = inline_read (inode, buffer, size, offset);
+      if (bytes_read >= 0)
+        return bytes_read;
+      bytes_read = 0; //#A moved out meanwhile, read it the usual way
+    }
   
   while (size > 0) //#A read > length, sector_idx = -1
     {
@@ -512,10 +870,21 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0) //#A IMPORTANT
         break;
+      //@4-2 in: read_at, a hole reads as zeros
+      void *kbuf;
+      if(sector_idx == 0)
+        memset(buffer + bytes_read, 0, chunk_size);
+      //@4-1 in: read_at, direct
+      else if (direct && chunk_size == BLOCK_SECTOR_SIZE
+               && (kbuf = direct_buffer (buffer + bytes_read)) != NULL)
+        cache_read_direct (sector_idx, kbuf);
+      else{
       //@4-1 in: read_at
       int cidx = get_entry_cache(sector_idx); //#A seem, no "sector" above
       memcpy(buffer + bytes_read, cache[cidx].data + sector_ofs, chunk_size);
-      cache[cidx].open_cnt--;
+      //@4-3 in: read_at
+      release_entry_cache(cidx, false);
+      }
         
       // if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
       //   {
@@ -546,14 +915,331 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset)
+{
+  return read_at (inode, buffer, size, offset, false);
+}
+
+//@4-1 F: inode_read_direct, for a file opened for direct I/O
+off_t
+inode_read_direct (struct inode *inode, void *buffer, off_t size,
+                   off_t offset)
+{
+  return read_at (inode, buffer, size, offset, true);
+}
+
+//@4-1 F: inode_read_ahead, after a read of SIZE bytes at OFFSET
+void
+inode_read_ahead (struct inode *inode, struct read_ahead *ra,
+                  off_t offset, off_t size)
+{
+  if (size <= 0)
+    return;
+  off_t first = offset / BLOCK_SECTOR_SIZE;
+  off_t last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+
+  //#A sequential: starts where the last read ended, or right after
+  if (first == ra->last || first == ra->last + 1){
+    if (ra->window == 0)
+      ra->window = 4;
+    else if (ra->window < CACHE_RA_MAX)
+      ra->window *= 2;
+    if (ra->window > CACHE_RA_MAX)
+      ra->window = CACHE_RA_MAX;
+  }
+  else{ //#A random access, stop prefetching
+    ra->window = 0;
+    ra->queued = 0;
+  }
+  ra->last = last;
+  if (ra->window == 0)
+    return;
+
+  if (inode->data.layout == INODE_LAYOUT_INLINE) //@4-2 C: nothing to read
+    return;
+  off_t end = last + 1 + ra->window;
+  off_t file_sectors = bytes_to_sectors (inode_length (inode));
+  if (end > file_sectors)
+    end = file_sectors;
+  off_t i = ra->queued > last + 1 ? ra->queued : last + 1;
+  for (; i < end; i++)
+    {
+      block_sector_t sector = byte_to_sector (inode, i * BLOCK_SECTOR_SIZE,
+                                              false);
+      if (sector != 0) //@4-2 C: nothing to prefetch in a hole
+        cache_read_ahead (sector);
+    }
+  if (i > ra->queued)
+    ra->queued = i;
+}
+
+//@4-2 F: hole_fill_mem, *SLOT in INODE_MEM itself
+//#A META: the new sector is an indirect block, journal it
+static block_sector_t
+hole_fill_mem (struct inode_mem *inode_mem, block_sector_t *slot, bool meta)
+{
+  if (*slot == 0 && goal_alloc (inode_mem, slot))
+    cache_zero (*slot, meta, inode_mem->sector);
+  return *slot;
+}
+
+//@4-2 F: hole_fill_ptr, pointer IDX in indirect block TABLE
+static block_sector_t
+hole_fill_ptr (struct inode_mem *inode_mem, block_sector_t table, size_t idx,
+               bool meta)
+{
+  block_sector_t sector;
+  cache_read_at (table, &sector, idx * 4, 4);
+  if (sector == 0 && goal_alloc (inode_mem, &sector))
+    {
+      cache_zero (sector, meta, inode_mem->sector);
+      cache_write_meta (table, &sector, idx * 4, 4, inode_mem->sector);
+    }
+  return sector;
+}
+
+//@4-2 F: sparse_fill
+/* Gives the hole at logical sector LSEC of INODE a zeroed sector,
+   together with any indirect block missing on the way to it, and
+   writes the inode back.  Returns the new sector, or 0 if the disk
+   is full. */
+static block_sector_t
+sparse_fill (struct inode *inode, block_sector_t lsec)
+{
+  struct inode_mem *inode_mem = &inode->data;
+  block_sector_t ent_num = BLOCK_SECTOR_SIZE / 4;
+  block_sector_t sector = 0;
+  ASSERT (inode_mem->layout == INODE_LAYOUT_BLOCKS);
+
+  //#A already held by a growing inode_write_at
+  bool held = lock_held_by_current_thread (&inode->inode_lock);
+  if (!held)
+    lock_acquire (&inode->inode_lock);
+  if (lsec < INODE_L1_SIZE)
+    sector = hole_fill_mem (inode_mem, &inode_mem->L1_sec[lsec], false);
+  else if (lsec < INODE_L2_SIZE)
+    {
+      if (hole_fill_mem (inode_mem, &inode_mem->L2_sec, true) != 0)
+        sector = hole_fill_ptr (inode_mem, inode_mem->L2_sec,
+                                lsec - INODE_L1_SIZE, false);
+    }
+  else if (hole_fill_mem (inode_mem, &inode_mem->L3_sec, true) != 0)
+    {
+      block_sector_t indirect = hole_fill_ptr (inode_mem, inode_mem->L3_sec,
+                                               (lsec - INODE_L2_SIZE) / ent_num,
+                                               true);
+      if (indirect != 0)
+        sector = hole_fill_ptr (inode_mem, indirect,
+                                (lsec - INODE_L2_SIZE) % ent_num, false);
+    }
+  inode_data_write_down (inode->sector, inode_mem);
+  free_map_flush ();
+  if (sector != 0 && lsec >= INODE_L1_SIZE)
+    inode_map_add (inode, lsec, sector);
+  if (!held)
+    lock_release (&inode->inode_lock);
+  return sector;
+}
+
+//@4-2 F: inline_migrate
+/* Moves the inline data of INODE out to a data sector of its own,
+   in the layout a new inode would get, so it can grow past
+   INODE_INLINE_MAX.  inode_lock must be held; the caller writes the
+   inode back.  Returns false if the disk is full. */
+static bool
+inline_migrate (struct inode *inode)
+{
+  struct inode_mem *inode_mem = &inode->data;
+  uint8_t data[BLOCK_SECTOR_SIZE];
+  block_sector_t sector;
+  ASSERT (inode_mem->layout == INODE_LAYOUT_INLINE);
+  ASSERT (inode_mem->length <= INODE_INLINE_MAX);
+
+  memset (data, 0, BLOCK_SECTOR_SIZE);
+  memcpy (data, inode_mem->inline_data, inode_mem->length);
+  if (inode_mem->length > 0 && !goal_alloc (inode_mem, &sector))
+    return false;
+  memset (inode_mem->inline_data, 0, INODE_INLINE_MAX); //#A ext[] too
+  inode_mem->layout = inode_use_extents ? INODE_LAYOUT_EXTENT
+                                        : INODE_LAYOUT_BLOCKS;
+  inode_mem->ext_cnt = 0;
+  if (inode_mem->length == 0)
+    return true;
+  cache_write_at (sector, data, 0, BLOCK_SECTOR_SIZE, inode->sector);
+  if (inode_mem->layout == INODE_LAYOUT_EXTENT)
+    {
+      inode_mem->ext[0].start = sector;
+      inode_mem->ext[0].length = 1;
+      inode_mem->ext_cnt = 1;
+    }
+  else
+    inode_mem->L1_sec[0] = sector;
+  inode_mem->sec_num = 1;
+  return true;
+}
+
+//@4-2 F: inline_write, false if INODE is not (or no longer) inline
+//#A HELD: inode_lock already taken by a growing write_at
+static bool
+inline_write (struct inode *inode, const void *buffer, off_t size,
+              off_t offset, bool held)
+{
+  uint8_t data[INODE_INLINE_MAX];
+  bool done = false;
+
+  if (offset + size > INODE_INLINE_MAX)
+    return false;
+  memcpy (data, buffer, size); //#A user BUFFER may fault, copy it first
+  if (!held)
+    lock_acquire (&inode->inode_lock);
+  if (inode->data.layout == INODE_LAYOUT_INLINE)
+    {
+      memcpy (inode->data.inline_data + offset, data, size);
+      if (!held) //#A a growing write_at writes the inode back itself
+        inode_data_write_down (inode->sector, &inode->data);
+      done = true;
+    }
+  if (!held)
+    lock_release (&inode->inode_lock);
+  return done;
+}
+
+//@4-2 S: sector_run, what is left of the last run from the free map
+struct sector_run{
+    block_sector_t start;
+    size_t left;
+  };
+
+//@4-2 F: run_take, next sector of RUN, a new run of up to WANT if empty
+static block_sector_t
+run_take (struct inode_mem *inode_mem, struct sector_run *run, size_t want)
+{
+  if (run->left == 0)
+    {
+      run->left = free_map_allocate_run (inode_mem->goal, want, &run->start);
+      if (run->left == 0)
+        return 0;
+    }
+  run->left--;
+  inode_mem->goal = run->start + 1;
+  return run->start++;
+}
+
+//@4-2 F: table_load
+/* Makes TABLE hold the indirect block *PTR, taking it from RUN if
+   *PTR is a hole, and marks *PTR_DIRTY then (the block *PTR lives in,
+   NULL for the inode).  *CUR is the block TABLE held so far, written
+   back first if *DIRTY.  Returns false if the disk is full. */
+static bool
+table_load (struct inode_mem *inode_mem, struct sector_run *run, size_t want,
+            block_sector_t *ptr, bool *ptr_dirty,
+            block_sector_t table[], block_sector_t *cur, bool *dirty)
+{
+  bool fresh = *ptr == 0;
+  if (!fresh && *ptr == *cur)
+    return true;
+  if (fresh)
+    {
+      *ptr = run_take (inode_mem, run, want);
+      if (*ptr == 0)
+        return false;
+      if (ptr_dirty != NULL)
+        *ptr_dirty = true;
+    }
+  if (*dirty)
+    cache_write_meta (*cur, table, 0, BLOCK_SECTOR_SIZE, inode_mem->sector);
+  if (fresh) //#A written whole later, never read from disk
+    memset (table, 0, BLOCK_SECTOR_SIZE);
+  else
+    cache_read_at (*ptr, table, 0, BLOCK_SECTOR_SIZE);
+  *cur = *ptr;
+  *dirty = fresh;
+  return true;
+}
+
+//@4-2 F: sparse_fill_range
+/* Fills every hole among the sectors that bytes OFFSET...OFFSET+SIZE
+   of INODE fall in, with runs from the free map rather than a sector
+   at a time, and writes each indirect block it touches once.  A
+   sector the write covers whole is not zeroed first if it lies past
+   the length, where no reader can see it before the write is done
+   and the length moves.  inode_lock must be held; the caller writes
+   the inode back and flushes the free map.  A hole left when the
+   disk fills up goes to sparse_fill later. */
+static void
+sparse_fill_range (struct inode *inode, off_t offset, off_t size)
+{
+  struct inode_mem *inode_mem = &inode->data;
+  block_sector_t ent_num = BLOCK_SECTOR_SIZE / 4;
+  block_sector_t lsec = offset / BLOCK_SECTOR_SIZE;
+  block_sector_t end = DIV_ROUND_UP (offset + size, BLOCK_SECTOR_SIZE);
+  block_sector_t top[BLOCK_SECTOR_SIZE / 4];   //#A L3_sec
+  block_sector_t table[BLOCK_SECTOR_SIZE / 4]; //#A L2_sec, or one under L3
+  block_sector_t top_sec = 0, table_sec = 0;
+  bool top_dirty = false, table_dirty = false;
+  struct sector_run run = {0, 0};
+  ASSERT (inode_mem->layout == INODE_LAYOUT_BLOCKS);
+  ASSERT (lock_held_by_current_thread (&inode->inode_lock));
+
+  if (size <= 0)
+    return;
+  if (end > FILE_MAX_SECTORS)
+    end = FILE_MAX_SECTORS;
+  for (; lsec < end; lsec++)
+    {
+      block_sector_t *slot;
+      if (lsec < INODE_L1_SIZE)
+        slot = &inode_mem->L1_sec[lsec];
+      else if (lsec < INODE_L2_SIZE)
+        {
+          if (!table_load (inode_mem, &run, end - lsec, &inode_mem->L2_sec,
+                           NULL, table, &table_sec, &table_dirty))
+            break;
+          slot = &table[lsec - INODE_L1_SIZE];
+        }
+      else
+        {
+          if (!table_load (inode_mem, &run, end - lsec, &inode_mem->L3_sec,
+                           NULL, top, &top_sec, &top_dirty)
+              || !table_load (inode_mem, &run, end - lsec,
+                              &top[(lsec - INODE_L2_SIZE) / ent_num],
+                              &top_dirty, table, &table_sec, &table_dirty))
+            break;
+          slot = &table[(lsec - INODE_L2_SIZE) % ent_num];
+        }
+      if (*slot != 0)
+        continue;
+      *slot = run_take (inode_mem, &run, end - lsec);
+      if (*slot == 0) //#A disk full
+        break;
+      if (lsec >= INODE_L1_SIZE)
+        table_dirty = true;
+      //#A readers can reach it before the write does if it lies
+      //#A below the old length, so only one past it may go unzeroed
+      off_t pos = (off_t) lsec * BLOCK_SECTOR_SIZE;
+      if (pos < offset || pos + BLOCK_SECTOR_SIZE > offset + size
+          || pos < inode_mem->length)
+        cache_zero (*slot, false, inode_mem->sector);
+    }
+  if (table_dirty)
+    cache_write_meta (table_sec, table, 0, BLOCK_SECTOR_SIZE,
+                      inode_mem->sector);
+  if (top_dirty)
+    cache_write_meta (top_sec, top, 0, BLOCK_SECTOR_SIZE, inode_mem->sector);
+  if (run.left > 0) //#A some of the range was there already
+    free_map_release (run.start, run.left);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
    (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+   growth is not yet implemented.)
+   //@4-1 C: DIRECT: whole data sectors skip the cache */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size,
+          off_t offset, bool direct)
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
@@ -561,17 +1247,46 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
   if (inode->deny_write_cnt)
     return 0;
+  //@4-2 in: inode_write_at, one journal operation; directory and
+  //#A free map contents are metadata, logged like inodes
+  bool meta = inode->data.is_directory || inode->sector == FREE_MAP_SECTOR;
+  journal_begin (JOURNAL_OP_MAX);
   
   //@4-3 in: inode_write_at.1
+  //#A ending right at EOF is no growth; the free map file never grows,
+  //#A it is written by free_map_flush, which can't allocate
   bool grow = false;
-  if(offset + size >= inode->data.length)
+  if(offset + size > inode->data.length && inode->sector != FREE_MAP_SECTOR)
     grow = true;
   if(grow == true){
     lock_acquire(&inode->inode_lock);
-    size_t dest_sector = bytes_to_sectors(offset + size);
-    ASSERT(inode_sector_allocate(dest_sector, &inode->data));
+    //@4-2 in: inode_write_at, inline data that won't fit any more moves out
+    //#A disk full: it stays inline, the write ends short at INODE_INLINE_MAX
+    if(inode->data.layout == INODE_LAYOUT_INLINE
+       && offset + size > INODE_INLINE_MAX && !inline_migrate(inode))
+      size = offset < INODE_INLINE_MAX ? INODE_INLINE_MAX - offset : 0;
+    if(inode->data.layout != INODE_LAYOUT_INLINE){
+      size_t dest_sector = bytes_to_sectors(offset + size);
+      //@4-2 in: inode_write_at, disk full or too many extents: write short,
+      //#A up to the last sector that did get allocated
+      if(!inode_sector_allocate(dest_sector, &inode->data, offset, size)){
+        off_t room = (off_t) inode->data.sec_num * BLOCK_SECTOR_SIZE - offset;
+        size = room <= 0 ? 0 : (room < size ? room : size);
+      }
+      //@4-2 in: inode_write_at, the holes about to be written, in one go
+      if(inode->data.layout == INODE_LAYOUT_BLOCKS)
+        sparse_fill_range(inode, offset, size);
+      free_map_flush(); //@4-2 in: inode_write_at, one free map write per growth
+    }
     //@4-1* in: write_at.1
-    inode->write_length = offset + size;
+    if(size > 0 && offset + size > inode->data.length) //#A 0: nothing got room
+      inode->write_length = offset + size;
+  }
+  //@4-2 in: write_at, a small file is written in its inode sector
+  if(inode->data.layout == INODE_LAYOUT_INLINE
+     && inline_write(inode, buffer, size, offset, grow)){
+    bytes_written = size;
+    size = 0;
   }
 
   while (size > 0)
@@ -579,6 +1294,13 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       /* Sector to write, starting byte offset within sector. */
       //@4-1* C: B2S.w.ver
       block_sector_t sector_idx = byte_to_sector (inode, offset, true);
+      //@4-2 in: write_at, first write into a hole
+      if (sector_idx == 0)
+        {
+          sector_idx = sparse_fill (inode, offset / BLOCK_SECTOR_SIZE);
+          if (sector_idx == 0) //#A disk full
+            break;
+        }
 
       int sector_ofs = offset % BLOCK_SECTOR_SIZE; //#A offset changes in-while
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -592,11 +1314,23 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
-      //@4-1 in: write_at.3
-      int cidx = get_entry_cache(sector_idx); //#A seem, no "sector" above
+      //@4-1 in: write_at, direct; metadata always goes through the journal
+      void *kbuf;
+      if (direct && !meta && chunk_size == BLOCK_SECTOR_SIZE
+          && (kbuf = direct_buffer (buffer + bytes_written)) != NULL)
+        cache_write_direct (sector_idx, kbuf, inode->sector);
+      else{
+      //@4-1 in: write_at.3, a whole sector is not read first
+      int cidx = chunk_size == BLOCK_SECTOR_SIZE
+                 ? get_entry_cache_write(sector_idx)
+                 : get_entry_cache(sector_idx);
       memcpy(cache[cidx].data + sector_ofs, buffer + bytes_written, chunk_size);
-      cache[cidx].dirty = true;
-      cache[cidx].open_cnt--;
+      cache[cidx].owner = inode->sector; //@4-1 in: write_at.3, for fsync
+      if (meta)
+        journal_log(cidx);
+      //@4-3 in: write_at.3
+      release_entry_cache(cidx, true);
+      }
         
       // if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
       //   {
@@ -631,16 +1365,72 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   free (bounce); //#A in pintos, free(NULL) cause nothing.
   //@4-3 in: inode_write_at.2
   if(grow == true){
-    lock_release(&inode->inode_lock);
+    //@4-2 in: write_at, cut short (disk full): the file ends where
+    //#A the write stopped, OFFSET has moved up to it
+    if(inode->write_length > offset)
+      inode->write_length = offset > inode->data.length ? offset
+                                                        : inode->data.length;
     //@4-1* in: write_at.4
     inode->data.length = inode->write_length;
     //@4-2 in: inode_write_at
     inode_data_write_down(inode->sector, &inode->data);
+    lock_release(&inode->inode_lock);
   }
+  journal_end ();
     
   return bytes_written;
 }
 
+//@4-2 F: write_split, write_at one INODE_WRITE_CHUNK at a time
+/* Each piece is its own journal operation, so however long the
+   write, no operation logs more indirect blocks and free map
+   sectors than journal_begin reserved for it. */
+static off_t
+write_split (struct inode *inode, const uint8_t *buffer, off_t size,
+             off_t offset, bool direct)
+{
+  off_t bytes_written = 0;
+  do
+    {
+      off_t chunk = size - bytes_written < INODE_WRITE_CHUNK
+                    ? size - bytes_written : INODE_WRITE_CHUNK;
+      off_t done = write_at (inode, buffer + bytes_written, chunk,
+                             offset + bytes_written, direct);
+      bytes_written += done;
+      if (done < chunk)
+        break;
+    }
+  while (bytes_written < size);
+  return bytes_written;
+}
+
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+                off_t offset)
+{
+  return write_split (inode, buffer, size, offset, false);
+}
+
+//@4-1 F: inode_write_direct, for a file opened for direct I/O
+off_t
+inode_write_direct (struct inode *inode, const void *buffer, off_t size,
+                    off_t offset)
+{
+  return write_split (inode, buffer, size, offset, true);
+}
+
+//@4-1 F: inode_sync
+/* Writes INODE's dirty sectors in the buffer cache to disk, in
+   sector order, then commits the journal, which holds its logged
+   metadata.  Other inodes' dirty data stays in the cache. */
+void
+inode_sync (struct inode *inode)
+{
+  ASSERT (inode != NULL);
+  cache_flush_owner (inode->sector);
+  journal_commit ();
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -7,8 +7,19 @@
 #define INODE_L1_SIZE 16
 #define INODE_L2_SIZE 144
 #define FILE_MAX_SECTORS 16384
+//@4-1 Global-Val
+#define INODE_MAP_SIZE 64 //#A per-inode logical->physical slots
+//@4-2 Global-Val, set by -extents
+extern bool inode_use_extents;
 struct bitmap;
 
+//@4-1 S: read_ahead, sequential detection for one open file
+struct read_ahead{
+    off_t last;      //#A last logical sector read, -1 if none
+    off_t window;    //#A sectors to keep ahead, 0 if not sequential
+    off_t queued;    //#A logical sectors below this are already queued
+};
+
 void inode_init (void);
 //@4-4 C: IC.d.ver
 bool inode_create (block_sector_t, off_t, bool, block_sector_t dir_in);
@@ -20,6 +31,10 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_read_direct (struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+                          off_t offset);
+void inode_sync (struct inode *);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
@@ -35,7 +50,8 @@ uint32_t lv2_allocate(size_t sectors, struct inode_mem *inode_mem);
 //@4-2 F: lv3_allocate
 uint32_t lv3_allocate(size_t sectors, struct inode_mem *inode_mem);
 //@4-2 T: inode_sector_allocate
-bool inode_sector_allocate(size_t sectors, struct inode_mem *inode_mem);
+bool inode_sector_allocate(size_t sectors, struct inode_mem *inode_mem,
+                           off_t offset, off_t size);
 //@4-2 F: lv1_free
 uint32_t lv1_free(struct inode_mem *inode_mem);
 //@4-2 F: lv2_free
@@ -49,6 +65,9 @@ void inode_data_read_up(block_sector_t, struct inode_mem *);
 //@4-2 F: inode_data_write_down
 void inode_data_write_down(block_sector_t, struct inode_mem *);
 
+//@4-1 F: inode_read_ahead
+void inode_read_ahead(struct inode *, struct read_ahead *,
+                      off_t offset, off_t size);
 //@4-4 F: inode_get_dir_in
 block_sector_t inode_get_dir_in(const struct inode *inode);
 //@4-4 F: inode_is_dir
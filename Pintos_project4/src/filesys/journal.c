@@ -0,0 +1,239 @@
+//@4-2 #include
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.  Inode sectors, indirect blocks, directory
+   data and the free map are logged: the cache entry is held (not
+   evicted, not flushed) until its transaction commits.  A commit
+   copies every held sector into the log area in one sequential
+   run, writes the header naming their homes (the commit record),
+   writes them home (checkpoint) and clears the header.  Many
+   operations share one transaction (group commit); a new
+   operation waits while one is being committed.
+   Each operation reserves the most sectors it can log at
+   journal_begin, waiting until the transaction has that much room
+   left, so a transaction never fills up in the middle of one.  The
+   free map is left out of that: every transaction keeps room for
+   all of its sectors, which operations share. */
+
+#define JOURNAL_MAGIC 0x4a524e4c
+
+//@4-2 S: journal_header, at JOURNAL_SECTOR
+struct journal_header{
+    uint32_t magic;
+    uint32_t seq;                         //#A commits so far
+    uint32_t cnt;                         //#A 0: nothing to replay
+    block_sector_t sector[JOURNAL_CAP];   //#A home of log sector i
+};
+
+//@4-2 Global-Val
+static bool journal_enabled;            //#A off until journal_init
+static struct lock journal_lock;        //#A all below
+static struct condition journal_idle;   //#A active hits 0, or commit done
+static int active;                      //#A threads inside begin/end
+static bool committing;
+static uint32_t txn_id = 1;             //#A running transaction
+static block_sector_t txn_sector[JOURNAL_HOLD_MAX];
+static size_t txn_cnt, txn_max;
+static size_t reserved;                 //#A room promised to active ops
+static size_t fm_max, fm_cnt;           //#A free map room; of txn_cnt, its
+static uint32_t journal_seq;
+static struct lock commit_lock;         //#A one commit at a time
+static unsigned long long commit_cnt, logged_cnt;
+
+//@4-2 F: sort_sectors, insertion sort, CNT is small
+static void sort_sectors(block_sector_t *s, size_t cnt){
+    for (size_t i = 1; i < cnt; i++){
+        block_sector_t x = s[i];
+        size_t j = i;
+        for (; j > 0 && s[j - 1] > x; j--)
+            s[j] = s[j - 1];
+        s[j] = x;
+    }
+}
+//@4-2 F: journal_size
+size_t journal_size(void){
+    size_t size = block_size(fs_device) / 32;
+    return size < JOURNAL_CAP ? size : JOURNAL_CAP;
+}
+//@4-2 F: journal_create
+void journal_create(void){
+    struct journal_header *h = calloc(1, BLOCK_SECTOR_SIZE);
+    ASSERT(sizeof *h <= BLOCK_SECTOR_SIZE);
+    if (h == NULL)
+        PANIC("journal creation failed");
+    h->magic = JOURNAL_MAGIC;
+    block_write(fs_device, JOURNAL_SECTOR, h);
+    free(h);
+}
+//@4-2 F: journal_init
+//#A before anything reads metadata through the cache
+void journal_init(void){
+    struct journal_header *h = malloc(BLOCK_SECTOR_SIZE);
+    uint8_t *buf = malloc(BLOCK_SECTOR_SIZE);
+    if (h == NULL || buf == NULL)
+        PANIC("journal init failed");
+    lock_init(&journal_lock);
+    lock_init(&commit_lock);
+    cond_init(&journal_idle);
+    block_read(fs_device, JOURNAL_SECTOR, h);
+    if (h->magic == JOURNAL_MAGIC){
+        journal_seq = h->seq;
+        if (h->cnt > 0 && h->cnt <= journal_size()){ //#A committed, replay
+            for (uint32_t i = 0; i < h->cnt; i++){
+                block_read(fs_device, JOURNAL_SECTOR + 1 + i, buf);
+                block_write(fs_device, h->sector[i], buf);
+            }
+            printf("journal: replayed %u sectors\n", (unsigned) h->cnt);
+            h->cnt = 0;
+            block_write(fs_device, JOURNAL_SECTOR, h);
+        }
+    }
+    free(h);
+    free(buf);
+    txn_max = journal_size() < JOURNAL_HOLD_MAX ? journal_size()
+                                                : JOURNAL_HOLD_MAX;
+    fm_max = free_map_sectors();
+    if (txn_max < fm_max + JOURNAL_CREATE_MAX){ //#A can't fit one create
+        printf("journal: log too small for this file system, not logging\n");
+        return;
+    }
+    journal_enabled = true;
+}
+//@4-2 F: journal_begin
+void journal_begin(size_t cnt){
+    struct thread *t = thread_current();
+    if (t->journal_depth++ > 0 || !journal_enabled)
+        return;
+    ASSERT(cnt <= JOURNAL_CREATE_MAX);
+    lock_acquire(&journal_lock);
+    //@4-2 C: or until there is room for this operation too
+    while (committing || txn_cnt >= JOURNAL_COMMIT_AT
+           || txn_cnt - fm_cnt + reserved + cnt > txn_max - fm_max){
+        if (!committing && active == 0){ //#A nobody else will commit it
+            lock_release(&journal_lock);
+            journal_commit();
+            lock_acquire(&journal_lock);
+        }
+        else
+            cond_wait(&journal_idle, &journal_lock);
+    }
+    active++;
+    reserved += cnt;
+    t->journal_left = cnt;
+    lock_release(&journal_lock);
+}
+//@4-2 F: journal_end, the last one out commits a full transaction
+void journal_end(void){
+    struct thread *t = thread_current();
+    ASSERT(t->journal_depth > 0);
+    if (--t->journal_depth > 0 || !journal_enabled)
+        return;
+    lock_acquire(&journal_lock);
+    reserved -= t->journal_left; //#A give back what's left
+    bool commit = --active == 0 && txn_cnt >= JOURNAL_COMMIT_AT;
+    cond_broadcast(&journal_idle, &journal_lock); //#A room, or idle
+    lock_release(&journal_lock);
+    if (commit)
+        journal_commit();
+}
+//@4-2 F: journal_log
+void journal_log(int cidx){
+    struct cache_entry *ce = &cache[cidx];
+    ASSERT(lock_held_by_current_thread(&ce->entry_lock));
+    if (!journal_enabled)
+        return;
+    lock_acquire(&journal_lock);
+    if (ce->held_txn != txn_id){
+        //#A reserved at journal_begin, so there is always room
+        struct thread *t = thread_current();
+        if (ce->owner == FREE_MAP_SECTOR)
+            fm_cnt++;
+        else if (t->journal_depth > 0){
+            //#A more than its journal_begin said it could
+            ASSERT(t->journal_left > 0);
+            t->journal_left--;
+            reserved--;
+        }
+        txn_sector[txn_cnt++] = ce->sector;
+        ce->held_txn = txn_id;
+    }
+    lock_release(&journal_lock);
+}
+//@4-2 F: journal_commit
+void journal_commit(void){
+    if (!journal_enabled)
+        return;
+    struct journal_header *h = calloc(1, BLOCK_SECTOR_SIZE);
+    if (h == NULL)
+        return; //#A stays held, try again next time
+    lock_acquire(&commit_lock);
+    lock_acquire(&journal_lock);
+    while (active > 0)
+        cond_wait(&journal_idle, &journal_lock);
+    committing = true;
+    uint32_t id = txn_id++;
+    size_t cnt = txn_cnt;
+    memcpy(h->sector, txn_sector, cnt * sizeof *txn_sector);
+    txn_cnt = fm_cnt = 0;
+    lock_release(&journal_lock);
+
+    if (cnt > 0){
+        int cidx[JOURNAL_HOLD_MAX];
+        const void *bufs[JOURNAL_HOLD_MAX];
+        struct cache_entry *run[JOURNAL_HOLD_MAX];
+        size_t i, n = 0;
+        //#A ascending, so entry_locks are taken in flush_cache's order
+        sort_sectors(h->sector, cnt);
+        for (i = 0; i < cnt; i++){
+            cidx[i] = get_entry_cache(h->sector[i]); //#A held, always a hit
+            bufs[i] = cache[cidx[i]].data;
+        }
+        //#A 1. log, one sequential request after the header
+        block_write_multi(fs_device, JOURNAL_SECTOR + 1, cnt, bufs);
+        //#A 2. commit record
+        h->magic = JOURNAL_MAGIC;
+        h->seq = ++journal_seq;
+        h->cnt = cnt;
+        block_write(fs_device, JOURNAL_SECTOR, h);
+        //#A 3. checkpoint, adjacent homes together; then evictable again
+        for (i = 0; i < cnt; i++){
+            struct cache_entry *ce = &cache[cidx[i]];
+            if (ce->held_txn == id)
+                ce->held_txn = 0;
+            if (n > 0 && ce->sector != run[n - 1]->sector + 1){
+                cache_write_run(run, n);
+                n = 0;
+            }
+            if (ce->dirty)
+                run[n++] = ce;
+            else
+                release_entry_cache(cidx[i], false);
+        }
+        cache_write_run(run, n);
+        //#A 4. all home, nothing to replay
+        h->cnt = 0;
+        block_write(fs_device, JOURNAL_SECTOR, h);
+        commit_cnt++;
+        logged_cnt += cnt;
+    }
+
+    lock_acquire(&journal_lock);
+    committing = false;
+    cond_broadcast(&journal_idle, &journal_lock);
+    lock_release(&journal_lock);
+    lock_release(&commit_lock);
+    free(h);
+}
+//@4-2 F: journal_print_stats
+void journal_print_stats(void){
+    printf("Journal: %llu commits, %llu sectors logged\n",
+           commit_cnt, logged_cnt);
+}
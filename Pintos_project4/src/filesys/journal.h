@@ -0,0 +1,34 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+//@4-2 #include
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/cache.h"
+//@4-2 Global-Val, metadata journal
+#define JOURNAL_SECTOR 2    //#A header (commit record), log sectors follow
+#define JOURNAL_CAP 125     //#A most log sectors one header can name
+#define JOURNAL_COMMIT_AT (CACHE_MAX_SIZE / 4) //#A group commit from here
+#define JOURNAL_HOLD_MAX (CACHE_MAX_SIZE / 2)  //#A never hold more than it
+#define JOURNAL_OP_MAX 8    //#A log room of an operation, free map aside
+#define JOURNAL_CREATE_MAX 16 //#A filesys_create's, see bucket_insert
+
+//@4-2 F: journal_size, log sectors reserved after JOURNAL_SECTOR
+size_t journal_size(void);
+//@4-2 F: journal_create, empty journal, at format
+void journal_create(void);
+//@4-2 F: journal_init, replay a committed transaction, then start logging
+void journal_init(void);
+//@4-2 F: journal_begin, an operation that logs up to CNT sectors besides
+//#A the free map starts, nests per thread (the outermost CNT counts)
+void journal_begin(size_t cnt);
+//@4-2 F: journal_end
+void journal_end(void);
+//@4-2 F: journal_log, CIDX (pinned, entry_lock held) joins the transaction
+void journal_log(int cidx);
+//@4-2 F: journal_commit, group commit and checkpoint
+void journal_commit(void);
+//@4-2 F: journal_print_stats
+void journal_print_stats(void);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __LIB_FSSTATS_H
+#define __LIB_FSSTATS_H
+
+#include <stdint.h>
+
+/* Latency buckets: bucket I counts requests that took from 2**I
+   to 2**(I+1) TSC cycles, submit to completion; the last bucket
+   also counts anything slower. */
+#define FSSTATS_LAT_CNT 32
+
+/* Queue depth buckets: bucket I counts requests that found I
+   others queued or in service; the last also counts deeper. */
+#define FSSTATS_DEPTH_CNT 16
+
+/* File system statistics, as filled in by the fsstats system
+   call.  Counts are since boot. */
+struct fsstats
+  {
+    int64_t ticks;                      /* Timer ticks since boot. */
+
+    /* Buffer cache. */
+    uint64_t cache_hits;                /* Lookups that found the sector. */
+    uint64_t cache_misses;              /* Lookups that loaded it. */
+    uint64_t cache_evictions;           /* Entries taken from a sector. */
+    uint64_t cache_evict_writes;        /* Dirty victims written back. */
+    uint64_t cache_flush_writes;        /* Sectors written by flushes. */
+    uint64_t ra_used;                   /* Prefetched sectors then read. */
+    uint64_t ra_wasted;                 /* Prefetched, never read. */
+    uint64_t direct;                    /* Sectors moved by direct I/O. */
+
+    /* File system disk. */
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+    uint64_t requests;                  /* Requests submitted. */
+    uint64_t transfers;                 /* Driver transfers, after merging. */
+    uint64_t read_lat[FSSTATS_LAT_CNT]; /* Read latency histogram. */
+    uint64_t write_lat[FSSTATS_LAT_CNT];        /* Write latency. */
+    uint64_t depth[FSSTATS_DEPTH_CNT];  /* Queue depth on submit. */
+  };
+
+#endif /* lib/fsstats.h */
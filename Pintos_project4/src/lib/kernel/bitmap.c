@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -358,6 +359,16 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Copies bytes OFS through OFS + SIZE - 1 of B's file image
+   (as written by bitmap_write()) into BUF. */
+void
+bitmap_copy_partial (const struct bitmap *b, void *buf,
+                     size_t ofs, size_t size)
+{
+  ASSERT (ofs + size <= byte_cnt (b->bit_cnt));
+  memcpy (buf, (const uint8_t *) b->bits + ofs, size);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -28,7 +28,13 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_DIRECTIO,               /* Turns direct I/O on a fd on or off. */
+    SYS_FSSTATS,                /* Reads file system statistics. */
+    SYS_FSYNC,                  /* Writes one file's data to disk. */
+    SYS_SYNC                    /* Writes all cached data to disk. */
   };
 
 #endif /* lib/syscall-nr.h */
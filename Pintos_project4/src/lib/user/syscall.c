@@ -182,3 +182,27 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+directio (int fd, bool on)
+{
+  return syscall2 (SYS_DIRECTIO, fd, (int) on);
+}
+
+bool
+fsstats (struct fsstats *st)
+{
+  return syscall1 (SYS_FSSTATS, st);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+void
+sync (void)
+{
+  syscall0 (SYS_SYNC);
+}
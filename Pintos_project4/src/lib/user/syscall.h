@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <fsstats.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +46,10 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool directio (int fd, bool on);
+bool fsstats (struct fsstats *);
+bool fsync (int fd);
+void sync (void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,60 @@
+/* Fills one directory with many files, then looks them up in
+   random order and removes them. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 300
+
+void
+test_main (void)
+{
+  static int order[FILE_CNT];
+  char name[16];
+  int i, fd;
+
+  CHECK (mkdir ("big"), "mkdir \"big\"");
+  quiet = true;
+
+  bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "big/f%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  bench_report ("create", 0);
+
+  for (i = 0; i < FILE_CNT; i++)
+    order[i] = i;
+  shuffle (order, FILE_CNT, sizeof *order);
+  bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "big/f%d", order[i]);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\"", name);
+      close (fd);
+    }
+  bench_report ("lookup", 0);
+
+  bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "big/nope%d", i);
+      if (open (name) != -1)
+        fail ("open \"%s\" should fail", name);
+    }
+  bench_report ("lookup-missing", 0);
+
+  bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "big/f%d", order[i]);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  bench_report ("remove", 0);
+}
@@ -0,0 +1,40 @@
+/* Creates, writes, closes and removes many small files. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ROUND_CNT 10
+#define FILE_CNT 20
+
+static char buf[1024];
+
+void
+test_main (void)
+{
+  char name[16];
+  int round, i, fd;
+
+  quiet = true;
+  bench_start ();
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < FILE_CNT; i++)
+        {
+          snprintf (name, sizeof name, "f%d", i);
+          CHECK (create (name, 0), "create \"%s\"", name);
+          CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+          if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+            fail ("write \"%s\"", name);
+          close (fd);
+        }
+      for (i = 0; i < FILE_CNT; i++)
+        {
+          snprintf (name, sizeof name, "f%d", i);
+          CHECK (remove (name), "remove \"%s\"", name);
+        }
+    }
+  bench_report ("churn", ROUND_CNT * FILE_CNT * sizeof buf);
+}
@@ -0,0 +1,35 @@
+/* Runs readers of one shared file and writers of their own
+   files at the same time. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/filesys/bench/child-bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define READER_CNT 2
+#define WRITER_CNT 2
+
+void
+test_main (void)
+{
+  pid_t children[READER_CNT + WRITER_CNT];
+  char cmd_line[64];
+  int i;
+
+  bench_make_file (CHILD_SHARED_FILE, CHILD_FILE_SIZE);
+  quiet = true;
+
+  bench_start ();
+  for (i = 0; i < READER_CNT + WRITER_CNT; i++)
+    {
+      snprintf (cmd_line, sizeof cmd_line, "child-bench %c %d",
+                i < READER_CNT ? 'r' : 'w', i);
+      CHECK ((children[i] = exec (cmd_line)) != PID_ERROR,
+             "exec \"%s\"", cmd_line);
+    }
+  for (i = 0; i < READER_CNT + WRITER_CNT; i++)
+    CHECK (wait (children[i]) == 0, "wait for child %d", i);
+  bench_report ("mixed", (READER_CNT + WRITER_CNT) * CHILD_FILE_SIZE);
+}
@@ -0,0 +1,48 @@
+/* Opens a file at the bottom of a deep directory tree, by
+   absolute and by relative path. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DEPTH 16
+#define OPEN_CNT 200
+
+void
+test_main (void)
+{
+  char path[DEPTH * 4 + 16];
+  int i, fd;
+
+  path[0] = '\0';
+  for (i = 0; i < DEPTH; i++)
+    {
+      snprintf (path + strlen (path), sizeof path - strlen (path), "/d%d", i);
+      CHECK (mkdir (path), "mkdir \"%s\"", path);
+    }
+  strlcat (path, "/leaf", sizeof path);
+  CHECK (create (path, 512), "create \"%s\"", path);
+
+  quiet = true;
+  bench_start ();
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      if ((fd = open (path)) < 2)
+        fail ("open \"%s\"", path);
+      close (fd);
+    }
+  bench_report ("open-absolute", 0);
+
+  CHECK (chdir ("/d0/d1/d2/d3/d4/d5/d6/d7"), "chdir");
+  bench_start ();
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      if ((fd = open ("d8/d9/d10/d11/d12/d13/d14/d15/leaf")) < 2)
+        fail ("open relative");
+      close (fd);
+    }
+  bench_report ("open-relative", 0);
+}
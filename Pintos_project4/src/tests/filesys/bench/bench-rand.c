@@ -0,0 +1,53 @@
+/* Random reads and writes within a 1 MB file, at several chunk
+   sizes. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (1024 * 1024)
+#define OP_CNT 256
+
+static char buf[4096];
+
+/* Does OP_CNT reads or writes of CHUNK bytes at random
+   CHUNK-aligned offsets in FD. */
+static void
+random_ops (int fd, size_t chunk, bool writing)
+{
+  char what[32];
+  int i;
+
+  snprintf (what, sizeof what, "%s-%zu", writing ? "write" : "read", chunk);
+  bench_start ();
+  for (i = 0; i < OP_CNT; i++)
+    {
+      size_t ofs = random_ulong () % (FILE_SIZE / chunk) * chunk;
+      seek (fd, ofs);
+      if ((writing ? write (fd, buf, chunk) : read (fd, buf, chunk))
+          != (int) chunk)
+        fail ("%s %zu bytes at %zu", writing ? "write" : "read", chunk, ofs);
+    }
+  bench_report (what, OP_CNT * chunk);
+}
+
+void
+test_main (void)
+{
+  static const size_t chunks[] = {512, 4096};
+  size_t i;
+  int fd;
+
+  bench_make_file ("rand", FILE_SIZE);
+  CHECK ((fd = open ("rand")) > 1, "open \"rand\"");
+  quiet = true;
+  for (i = 0; i < sizeof chunks / sizeof *chunks; i++)
+    {
+      random_ops (fd, chunks[i], false);
+      random_ops (fd, chunks[i], true);
+    }
+  close (fd);
+}
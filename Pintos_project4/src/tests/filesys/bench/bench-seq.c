@@ -0,0 +1,50 @@
+/* Sequential write and read of a 1 MB file, at several chunk
+   sizes. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (1024 * 1024)
+
+static char buf[16384];
+
+void
+test_main (void)
+{
+  static const size_t chunks[] = {512, 4096, 16384};
+  size_t i;
+
+  quiet = true;
+  for (i = 0; i < sizeof chunks / sizeof *chunks; i++)
+    {
+      size_t chunk = chunks[i];
+      char name[16], what[32];
+      size_t ofs;
+      int fd;
+
+      snprintf (name, sizeof name, "seq%zu", chunk);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+
+      snprintf (what, sizeof what, "write-%zu", chunk);
+      bench_start ();
+      for (ofs = 0; ofs < FILE_SIZE; ofs += chunk)
+        if (write (fd, buf, chunk) != (int) chunk)
+          fail ("write %zu bytes at %zu", chunk, ofs);
+      bench_report (what, FILE_SIZE);
+
+      seek (fd, 0);
+      snprintf (what, sizeof what, "read-%zu", chunk);
+      bench_start ();
+      for (ofs = 0; ofs < FILE_SIZE; ofs += chunk)
+        if (read (fd, buf, chunk) != (int) chunk)
+          fail ("read %zu bytes at %zu", chunk, ofs);
+      bench_report (what, FILE_SIZE);
+
+      close (fd);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+}
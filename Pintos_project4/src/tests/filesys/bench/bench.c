@@ -0,0 +1,65 @@
+/* Measurement helpers shared by the file system benchmarks.
+
+   Each measurement prints one line of the form
+     bench PROGRAM WHAT ticks=T reads=R writes=W ...
+   with the elapsed timer ticks and the change in the file system
+   disk and buffer cache counters, so that runs can be compared
+   with a script. */
+
+#include "tests/filesys/bench/bench.h"
+#include <fsstats.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+static struct fsstats before;
+
+/* Starts a measurement. */
+void
+bench_start (void)
+{
+  CHECK (fsstats (&before), "fsstats");
+}
+
+/* Ends the measurement started by bench_start() and reports it
+   as WHAT, which moved BYTES bytes of file data. */
+void
+bench_report (const char *what, size_t bytes)
+{
+  struct fsstats after;
+
+  if (!fsstats (&after))
+    fail ("fsstats");
+  printf ("bench %s %s ticks=%lld reads=%llu writes=%llu "
+          "requests=%llu transfers=%llu hits=%llu misses=%llu "
+          "evictions=%llu bytes=%zu\n",
+          test_name, what,
+          after.ticks - before.ticks,
+          after.sectors_read - before.sectors_read,
+          after.sectors_written - before.sectors_written,
+          after.requests - before.requests,
+          after.transfers - before.transfers,
+          after.cache_hits - before.cache_hits,
+          after.cache_misses - before.cache_misses,
+          after.cache_evictions - before.cache_evictions,
+          bytes);
+}
+
+/* Creates NAME with SIZE bytes of data, not measured. */
+void
+bench_make_file (const char *name, size_t size)
+{
+  static char block[4096];
+  size_t ofs;
+  int fd;
+
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  for (ofs = 0; ofs < size; ofs += sizeof block)
+    {
+      size_t n = size - ofs < sizeof block ? size - ofs : sizeof block;
+      if (write (fd, block, n) != (int) n)
+        fail ("write %zu bytes at %zu in \"%s\"", n, ofs, name);
+    }
+  close (fd);
+}
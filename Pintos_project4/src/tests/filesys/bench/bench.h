@@ -0,0 +1,11 @@
+#ifndef TESTS_FILESYS_BENCH_BENCH_H
+#define TESTS_FILESYS_BENCH_BENCH_H
+
+#include <stddef.h>
+
+void bench_start (void);
+void bench_report (const char *what, size_t bytes);
+
+void bench_make_file (const char *name, size_t size);
+
+#endif /* tests/filesys/bench/bench.h */
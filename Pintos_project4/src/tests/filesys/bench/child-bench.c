@@ -0,0 +1,43 @@
+/* Child process for bench-concurrent.
+   "child-bench r N" reads the shared file from start to end;
+   "child-bench w N" writes a file of its own of the same size. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/bench/child-bench.h"
+#include "tests/lib.h"
+
+static char buf[4096];
+
+int
+main (int argc, const char *argv[])
+{
+  char name[16];
+  size_t ofs;
+  int fd;
+
+  test_name = "child-bench";
+  quiet = true;
+
+  CHECK (argc == 3, "argc must be 3, actually %d", argc);
+  if (argv[1][0] == 'r')
+    {
+      CHECK ((fd = open (CHILD_SHARED_FILE)) > 1, "open \"%s\"",
+             CHILD_SHARED_FILE);
+      for (ofs = 0; ofs < CHILD_FILE_SIZE; ofs += sizeof buf)
+        if (read (fd, buf, sizeof buf) != (int) sizeof buf)
+          fail ("read at %zu", ofs);
+    }
+  else
+    {
+      snprintf (name, sizeof name, "w%d", atoi (argv[2]));
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      for (ofs = 0; ofs < CHILD_FILE_SIZE; ofs += sizeof buf)
+        if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+          fail ("write at %zu", ofs);
+    }
+  close (fd);
+  return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_BENCH_CHILD_BENCH_H
+#define TESTS_FILESYS_BENCH_CHILD_BENCH_H
+
+/* File all readers share, and the size of every file. */
+#define CHILD_SHARED_FILE "shared"
+#define CHILD_FILE_SIZE (256 * 1024)
+
+#endif /* tests/filesys/bench/child-bench.h */
@@ -0,0 +1,31 @@
+/* Library function for picking file names that all land in the
+   same directory bucket. */
+
+#include <stdio.h>
+#include "tests/filesys/extended/dir-hash.h"
+
+/* The kernel's hash_string(), 32-bit FNV-1. */
+static unsigned
+name_hash (const char *s_)
+{
+  const unsigned char *s = (const unsigned char *) s_;
+  unsigned hash = 2166136261u;
+
+  while (*s != '\0')
+    hash = (hash * 16777619u) ^ *s++;
+  return hash;
+}
+
+/* Stores in NAME the next name "f<N>", N >= *NEXT, whose hash has
+   the same low DIR_HASH_BITS bits as "f0"'s, and moves *NEXT past
+   it.  Start with *NEXT at 0. */
+void
+same_bucket_name (char *name, size_t size, int *next)
+{
+  unsigned mask = (1u << DIR_HASH_BITS) - 1;
+  unsigned want = name_hash ("f0") & mask;
+
+  do
+    snprintf (name, size, "f%d", (*next)++);
+  while ((name_hash (name) & mask) != want);
+}
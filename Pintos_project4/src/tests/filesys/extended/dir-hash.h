@@ -0,0 +1,13 @@
+#ifndef TESTS_FILESYS_EXTENDED_DIR_HASH_H
+#define TESTS_FILESYS_EXTENDED_DIR_HASH_H
+
+#include <stddef.h>
+
+/* Low bits of a name's hash that pick its directory bucket once
+   the directory can't split any more (DIR_DEPTH_MAX in
+   filesys/directory.c). */
+#define DIR_HASH_BITS 7
+
+void same_bucket_name (char *name, size_t size, int *next);
+
+#endif /* tests/filesys/extended/dir-hash.h */
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+$fs->{'x'}{$_} = [''] foreach qw (f15 f145 f484 f619 f835 f1030 f1207
+  f1445 f1593 f1849 f2233 f2505 f2691 f2978 f3120 f3568 f3847 f4068
+  f4420 f4855 f5157 f5315 f5531 f5852 f6185 f6527 f6826 f7065 f7339
+  f7634 f7858 f8051 f8293 f8419 f8684 f8864 f9162 f9478 f9632 f9892);
+check_archive ($fs);
+pass;
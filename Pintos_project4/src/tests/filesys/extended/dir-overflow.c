@@ -0,0 +1,67 @@
+/* Creates, in a new directory, 80 files whose names all hash to
+   the same bucket: more than one bucket at the deepest the
+   directory splits can hold, so the rest go on its overflow
+   chain.  Opens every file, removes every other one, and checks
+   that exactly the others are left. */
+
+#include <syscall.h>
+#include "tests/filesys/extended/dir-hash.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 80
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 1];
+  int next, i, fd, cnt;
+
+  CHECK (mkdir ("/x"), "mkdir \"/x\"");
+  CHECK (chdir ("/x"), "chdir \"/x\"");
+  msg ("creating %d files in one bucket", FILE_CNT);
+  quiet = true;
+  for (i = next = 0; i < FILE_CNT; i++)
+    {
+      same_bucket_name (name, sizeof name, &next);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("opening them");
+  quiet = true;
+  for (i = next = 0; i < FILE_CNT; i++)
+    {
+      same_bucket_name (name, sizeof name, &next);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+
+  msg ("removing every other one");
+  quiet = true;
+  for (i = next = 0; i < FILE_CNT; i++)
+    {
+      same_bucket_name (name, sizeof name, &next);
+      if (i % 2 == 0)
+        CHECK (remove (name), "remove \"%s\"", name);
+    }
+  for (i = next = 0; i < FILE_CNT; i++)
+    {
+      same_bucket_name (name, sizeof name, &next);
+      fd = open (name);
+      if ((fd > 1) != (i % 2 == 1))
+        fail ("open \"%s\" returned %d", name, fd);
+      if (fd > 1)
+        close (fd);
+    }
+  quiet = false;
+
+  CHECK ((fd = open (".")) > 1, "open \".\"");
+  for (cnt = 0; readdir (fd, name); cnt++)
+    continue;
+  close (fd);
+  if (cnt != FILE_CNT / 2)
+    fail ("readdir found %d files, expected %d", cnt, FILE_CNT / 2);
+  msg ("readdir found %d files", cnt);
+}
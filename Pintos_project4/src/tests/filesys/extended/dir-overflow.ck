@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-overflow) begin
+(dir-overflow) mkdir "/x"
+(dir-overflow) chdir "/x"
+(dir-overflow) creating 80 files in one bucket
+(dir-overflow) opening them
+(dir-overflow) removing every other one
+(dir-overflow) open "."
+(dir-overflow) readdir found 40 files
+(dir-overflow) end
+EOF
+pass;
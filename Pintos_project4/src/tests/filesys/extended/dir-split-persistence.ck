@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+$fs->{'x'}{$_} = [''] foreach qw (f0 f15 f82 f145 f251 f484 f530 f619
+  f707 f835 f981 f1030 f1184 f1207 f1319 f1445 f1508 f1593 f1751 f1849
+  f2080 f2233 f2246 f2505 f2592 f2691);
+check_archive ($fs);
+pass;
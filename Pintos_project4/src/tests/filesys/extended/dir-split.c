@@ -0,0 +1,42 @@
+/* Creates, in a new directory, 26 files whose names all hash to
+   the same bucket.  The first 25 fill it; the last one splits it
+   over and over in a single create, down to the deepest the
+   directory goes, and then chains an overflow bucket: the most
+   metadata one create writes.  Then opens every file. */
+
+#include <syscall.h>
+#include "tests/filesys/extended/dir-hash.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 26
+
+void
+test_main (void) 
+{
+  char name[32];
+  int next = 0;
+  int i, fd;
+
+  CHECK (mkdir ("/x"), "mkdir \"/x\"");
+  CHECK (chdir ("/x"), "chdir \"/x\"");
+  msg ("creating %d files in one bucket", FILE_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      same_bucket_name (name, sizeof name, &next);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("opening them");
+  quiet = true;
+  next = 0;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      same_bucket_name (name, sizeof name, &next);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-split) begin
+(dir-split) mkdir "/x"
+(dir-split) chdir "/x"
+(dir-split) creating 26 files in one bucket
+(dir-split) opening them
+(dir-split) end
+EOF
+pass;
@@ -69,7 +69,8 @@ static void usage (void);
 
 #ifdef FILESYS
 static void locate_block_devices (void);
-static void locate_block_device (enum block_type, const char *name);
+static void locate_block_device (enum block_type, const char *name,
+                                 enum block_type avoid);
 #endif
 
 int main (void) NO_RETURN;
@@ -251,6 +252,15 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      //@4-1 in: parse_options
+      else if (!strcmp (name, "-cache"))
+        {
+          if (!cache_set_policy (value))
+            PANIC ("unknown cache policy `%s' (use -h for help)", value);
+        }
+      //@4-2 in: parse_options
+      else if (!strcmp (name, "-extents"))
+        inode_use_extents = true;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -377,6 +387,8 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=POLICY      Use POLICY (clock, 2q) for buffer cache eviction.\n"
+          "  -extents           Allocate new files as extents, not indirect blocks.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -395,19 +407,39 @@ usage (void)
 static void
 locate_block_devices (void)
 {
-  locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
-  locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
+  locate_block_device (BLOCK_FILESYS, filesys_bdev_name, BLOCK_ROLE_CNT);
+  locate_block_device (BLOCK_SCRATCH, scratch_bdev_name, BLOCK_FILESYS);
 #ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
+  locate_block_device (BLOCK_SWAP, swap_bdev_name, BLOCK_FILESYS);
 #endif
 }
 
+/* Returns how much I/O to BLOCK would contend with I/O to
+   OTHER: 0 if none (OTHER is null, or they are on different IDE
+   channels), 1 if they are different disks on one channel, 2 if
+   they are on the same disk. */
+static int
+block_contention (struct block *block, struct block *other)
+{
+  if (other == NULL)
+    return 0;
+  if (block_root (block) == block_root (other))
+    return 2;
+  if (ide_channel (block) == ide_channel (other))
+    return 1;
+  return 0;
+}
+
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
-   otherwise the first block device in probe order of type
-   ROLE. */
+   otherwise the block device of type ROLE that contends least
+   with the one in role AVOID (BLOCK_ROLE_CNT for none), the first
+   in probe order on a tie.  So swap and scratch land on the other
+   channel from the file system when there is a choice, and their
+   transfers run in parallel with file system I/O. */
 static void
-locate_block_device (enum block_type role, const char *name)
+locate_block_device (enum block_type role, const char *name,
+                     enum block_type avoid)
 {
   struct block *block = NULL;
 
@@ -419,9 +451,17 @@ locate_block_device (enum block_type role, const char *name)
     }
   else
     {
-      for (block = block_first (); block != NULL; block = block_next (block))
-        if (block_type (block) == role)
-          break;
+      struct block *other = (avoid < BLOCK_ROLE_CNT
+                             ? block_get_role (avoid) : NULL);
+      struct block *b;
+      int best = 3;
+
+      for (b = block_first (); b != NULL; b = block_next (b))
+        if (block_type (b) == role && block_contention (b, other) < best)
+          {
+            block = b;
+            best = block_contention (b, other);
+          }
     }
 
   if (block != NULL)
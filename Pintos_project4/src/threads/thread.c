@@ -592,6 +592,9 @@ init_thread (struct thread *t, const char *name, int priority)
   list_init(&t->fd_list);
   //@4-4 init
   t->cur_dir = NULL;
+  //@4-2 init
+  t->journal_depth = 0;
+  t->journal_left = 0;
 
   //#A Origianl below
   old_level = intr_disable ();
@@ -130,6 +130,9 @@ struct thread
     struct file *exec_file;
     //@4-4 in: thread
     struct dir *cur_dir;
+    //@4-2 in: thread
+    int journal_depth;                  /* Nested journal_begin()s. */
+    int journal_left;                   /* Log room it may still take. */
   };
 
 /* If false (default), use round-robin scheduler.
@@ -20,10 +20,12 @@
 #include "threads/init.h"
 //@4-4 #include
 #include "filesys/directory.h"
+//@4-1 #include
+#include <fsstats.h>
 
 //@2-2 Global-Val
 //@4-4 Global-Val
-#define MAX_SYSCALL_NUM 20
+#define MAX_SYSCALL_NUM 24
 
 //@4-0 update FD
 static uint32_t global_fid = 2;
@@ -509,6 +511,65 @@ static void sc_inumber(struct intr_frame *f){
   return;
 }
 
+//@4-1 F: sc_directio: bool directio (int fd, bool on)
+static void sc_directio(struct intr_frame *f){
+  f->eax = (uint32_t) false;
+  if (!is_valid_a2(f->esp))
+    error_exit();
+  int fd = *(int *)(f->esp + 4);
+  bool on = *(int *)(f->esp + 8) != 0;
+  struct fd_struct *fds = find_fd_struct(fd);
+  if(fds == NULL)
+    return;
+  //#A ====== Valid-finished ======
+  if (inode_is_dir(file_get_inode(fds->file)))
+    return;
+  file_set_direct(fds->file, on);
+  f->eax = (uint32_t) true;
+  return;
+}
+
+//@4-1 F: sc_fsstats: bool fsstats (struct fsstats *)
+static void sc_fsstats(struct intr_frame *f){
+  f->eax = (uint32_t) false;
+  if (is_valid_a1(f->esp) == false)
+    error_exit();
+  struct fsstats *ust = *(struct fsstats **)(f->esp + 4);
+  if (is_valid_uptr(ust) == false ||
+      is_valid_uptr((uint8_t *) ust + sizeof *ust - 1) == false)
+    error_exit();
+  //#A ====== Valid-finished ======
+  struct fsstats st;
+  filesys_get_stats(&st);
+  memcpy(ust, &st, sizeof st);
+  f->eax = (uint32_t) true;
+  return;
+}
+
+//@4-1 F: sc_fsync: bool fsync (int fd)
+static void sc_fsync(struct intr_frame *f){
+  f->eax = (uint32_t) false;
+  if (is_valid_a1(f->esp) == false)
+    error_exit();
+  int fd = *(int *)(f->esp + 4);
+  struct fd_struct *fds = find_fd_struct(fd);
+  if(fds == NULL)
+    return;
+  //#A ====== Valid-finished ======
+  struct inode* inode = file_get_inode(fds->file);
+  if(inode == NULL)
+    return;
+  inode_sync(inode);
+  f->eax = (uint32_t) true;
+  return;
+}
+
+//@4-1 F: sc_sync: void sync (void)
+static void sc_sync(struct intr_frame *f UNUSED){
+  filesys_sync();
+  return;
+}
+
 void syscall_init(void)
 {
   intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
@@ -534,6 +595,11 @@ void syscall_init(void)
   sys_func_table[17] = sc_readdir;
   sys_func_table[18] = sc_isdir;
   sys_func_table[19] = sc_inumber;
+  //@4-1 in:syscall_init
+  sys_func_table[20] = sc_directio;
+  sys_func_table[21] = sc_fsstats;
+  sys_func_table[22] = sc_fsync;
+  sys_func_table[23] = sc_sync;
 
   //@2-4 file lock init
   lock_init(&file_lock);